@@ -0,0 +1,123 @@
+/*
+ * apex.h
+ * Embeddable APEX simulator, built as libapex.a and libapex.so
+ *
+ * A simulator holds all of its state, so any number of them may run at
+ * once, each on one thread at a time. Simulating never reads input or
+ * writes output, only apex_create reads the program file.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_H_
+#define _APEX_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returned by apex_step, apex_run_until and apex_status */
+#define APEX_STATUS_RUNNING 0x0 /* The program has not ended */
+#define APEX_STATUS_HALTED 0x1  /* HALT has retired */
+#define APEX_STATUS_FAULT 0x2   /* A LOAD or STORE fell outside data memory */
+#define APEX_STATUS_FETCH_FAULT 0x3 /* The pc left code memory */
+
+/* Condition flag bits returned by apex_flags */
+#define APEX_FLAG_ZERO 0x1
+#define APEX_FLAG_POSITIVE 0x2
+#define APEX_FLAG_NEGATIVE 0x4
+
+/* Events observers are registered for, one bit each */
+#define APEX_EVENT_FETCH 0x1      /* An instruction moved from Fetch to Decode */
+#define APEX_EVENT_ISSUE 0x2      /* It was issued for execution */
+#define APEX_EVENT_STALL 0x4      /* A stage held it for a cycle, detail is the cause */
+#define APEX_EVENT_FLUSH 0x8      /* It redirected fetch to address, squashing detail instructions */
+#define APEX_EVENT_MEM_ACCESS 0x10 /* It loaded (detail 0) or stored (1) value at address */
+#define APEX_EVENT_RETIRE 0x20    /* It retired, in program order */
+#define APEX_EVENT_ALL 0x3f
+
+typedef struct APEX_CPU APEX_CPU;
+
+/* Something that happened to one instruction in a simulated cycle */
+typedef struct apex_event
+{
+    int type;    /* APEX_EVENT_* */
+    long cycle;  /* Counted from 1 */
+    int pc;
+    long seq;    /* Dynamic instruction number, in fetch order */
+    int stage;   /* Stage it happened in, see apex_stage_name */
+    int detail;
+    int address;
+    int value;
+} apex_event;
+
+typedef void (*apex_observer)(APEX_CPU *cpu, const apex_event *event, void *arg);
+
+/* Called after every simulated cycle by apex_run_until, which stops once it
+ * returns non-zero */
+typedef int (*apex_predicate)(APEX_CPU *cpu, void *arg);
+
+/*
+ * Creates a simulator for the assembly or apex-asm binary program in
+ * filename, or for the assembly text in buffer. options lists
+ * microarchitecture parameters as name=value, separated by ';' or
+ * whitespace, with the names of apex_sim --config. It may be NULL.
+ *
+ * Return NULL on failure, with the reason in error when it is not NULL.
+ */
+APEX_CPU *apex_create(const char *filename, const char *options, char *error,
+                      size_t error_size);
+APEX_CPU *apex_create_from_buffer(const char *buffer, size_t length, const char *options,
+                                  char *error, size_t error_size);
+
+/* Simulates up to cycles clock cycles, returns the APEX_STATUS_* after them */
+int apex_step(APEX_CPU *cpu, long cycles);
+
+/* Simulates until predicate holds after a cycle, or to the end of the
+ * program when it is NULL. Cycles in which only latencies count down may be
+ * skipped over between two calls, they change no register, flag, memory
+ * word or pc. Returns the APEX_STATUS_* at that point. */
+int apex_run_until(APEX_CPU *cpu, apex_predicate predicate, void *arg);
+
+int apex_status(const APEX_CPU *cpu);
+long apex_cycles(const APEX_CPU *cpu);
+long apex_instructions(const APEX_CPU *cpu);
+int apex_pc(const APEX_CPU *cpu);
+
+/* Architectural state, committed in program order. Return 0 on success, -1
+ * if reg or address is out of range. */
+int apex_register(const APEX_CPU *cpu, int reg, int *value);
+int apex_flags(const APEX_CPU *cpu);
+int apex_memory(APEX_CPU *cpu, int address, int *value);
+
+/*
+ * Calls fn with every event of the types in events from now on. fn may read
+ * the state of cpu, but not step or destroy it. The loads of the
+ * out-of-order core include those on a mispredicted path.
+ *
+ * Events nobody observes cost a test at most, cycles are only simulated one
+ * by one while stalls are observed. Returns a handle for apex_unobserve, or
+ * -1 if no more observers can be registered.
+ */
+int apex_observe(APEX_CPU *cpu, unsigned int events, apex_observer fn, void *arg);
+void apex_unobserve(APEX_CPU *cpu, int handle);
+
+/* Names of an apex_event stage and of the cause of an APEX_EVENT_STALL */
+const char *apex_stage_name(int stage);
+const char *apex_stall_cause_name(int cause);
+
+/* Returns 0 and the pc and data address of the access that stopped the
+ * program with APEX_STATUS_FAULT, or the pc outside code memory in both for
+ * APEX_STATUS_FETCH_FAULT, -1 if it did not fault */
+int apex_fault(const APEX_CPU *cpu, int *pc, int *address);
+
+void apex_destroy(APEX_CPU *cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * apex_asm.c
+ * apex-asm: assembles an APEX program into a binary image of pre-decoded
+ * instructions that apex_sim maps directly into code memory
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_cpu.h"
+
+int main(int argc, char const *argv[])
+{
+    APEX_Instruction *code_memory;
+    int code_memory_size = 0;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> <output_image>\n", argv[0]);
+        exit(1);
+    }
+
+    code_memory = create_code_memory(argv[1], &code_memory_size, stderr);
+    if (!code_memory)
+    {
+        fprintf(stderr, "APEX_Error: Unable to parse %s\n", argv[1]);
+        exit(1);
+    }
+
+    if (write_code_image(argv[2], code_memory, code_memory_size) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", argv[2]);
+        free(code_memory);
+        exit(1);
+    }
+
+    fprintf(stderr, "APEX_ASM: Wrote %d instructions to %s\n", code_memory_size, argv[2]);
+    free(code_memory);
+    return 0;
+}
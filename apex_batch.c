@@ -0,0 +1,763 @@
+/*
+ * apex_batch.c
+ * Contains the parallel batch drivers. Independent APEX cpus are simulated
+ * on a pool of worker threads with work stealing, either one per program
+ * or one per point of a configuration sweep.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define MAX_SWEEP_PARAMS 16
+
+/* Runs job number job on worker, writing any output to sink */
+typedef void (*APEX_JobFn)(void *ctx, int job, int worker, FILE *sink);
+
+/* Outcome of one simulation */
+typedef struct APEX_BatchResult
+{
+    int ok;          /* The program ran to HALT */
+    int faulted;     /* It stopped on a memory or fetch fault */
+    int fetch_fault; /* The fault was a fetch outside code memory */
+    int invalid;     /* The configuration is invalid, it was not run */
+    int fault_pc;
+    int fault_address;
+    int cycles;
+    int instructions;
+    double host_seconds;
+    int worker;
+} APEX_BatchResult;
+
+/* Per-worker deque of job indices. The owner pops from the tail, idle
+ * workers steal from the head. */
+typedef struct APEX_JobQueue
+{
+    pthread_mutex_t lock;
+    int *jobs;
+    int head;
+    int tail;
+} APEX_JobQueue;
+
+typedef struct APEX_BatchPool
+{
+    APEX_JobFn run;
+    void *ctx;
+    APEX_JobQueue *queues;
+    int num_workers;
+} APEX_BatchPool;
+
+typedef struct APEX_BatchWorker
+{
+    APEX_BatchPool *pool;
+    int id;
+    FILE *sink; /* This worker's output, never shared with other workers */
+    pthread_t thread;
+} APEX_BatchWorker;
+
+/* Programs listed for APEX_batch_run_programs */
+typedef struct APEX_ProgramBatch
+{
+    char **programs;
+    const APEX_Config *config;
+    APEX_BatchResult *results;
+} APEX_ProgramBatch;
+
+/* One swept parameter and its values */
+typedef struct APEX_SweepParam
+{
+    char *name;
+    char **values;
+    int num_values;
+} APEX_SweepParam;
+
+typedef struct APEX_Sweep
+{
+    APEX_Instruction *code_memory; /* Decoded once, shared read-only */
+    int code_memory_size;
+    void *code_memory_map;
+    size_t code_memory_map_size;
+    const APEX_Config *base;
+    APEX_SweepParam params[MAX_SWEEP_PARAMS];
+    int num_params;
+    APEX_BatchResult *results;
+} APEX_Sweep;
+
+static double
+elapsed_seconds(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int
+pop_job(APEX_JobQueue *queue)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head)
+    {
+        job = queue->jobs[--queue->tail];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+static int
+steal_job(APEX_JobQueue *queue)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail > queue->head)
+    {
+        job = queue->jobs[queue->head++];
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+/* Takes the next job from the worker's own queue, or steals one. Jobs are
+ * never added once the pool is running, so -1 means all work is taken. */
+static int
+next_job(APEX_BatchWorker *worker)
+{
+    APEX_BatchPool *pool = worker->pool;
+    int i, job;
+
+    job = pop_job(&pool->queues[worker->id]);
+    for (i = 1; job < 0 && i < pool->num_workers; ++i)
+    {
+        job = steal_job(&pool->queues[(worker->id + i) % pool->num_workers]);
+    }
+    return job;
+}
+
+static void *
+worker_main(void *arg)
+{
+    APEX_BatchWorker *worker = arg;
+    int job;
+
+    while ((job = next_job(worker)) >= 0)
+    {
+        worker->pool->run(worker->pool->ctx, job, worker->id, worker->sink);
+    }
+    return NULL;
+}
+
+/*
+ * Runs num_jobs jobs on up to num_threads workers (one per host core if
+ * num_threads <= 0). Each worker writes to its own sink, <log_prefix>.<worker>
+ * if log_prefix is given and discarded otherwise. A worker whose thread
+ * cannot be started is run on the calling thread once the others are
+ * started, so every job still runs.
+ *
+ * Returns 0 and sets *threads_used, the threads that ran jobs, and the
+ * wall-clock time taken, or -1 if the pool cannot be allocated, in which
+ * case no job has run.
+ */
+static int
+run_pool(int num_jobs, int num_threads, APEX_JobFn run, void *ctx,
+         const char *log_prefix, int *threads_used, double *wall_seconds)
+{
+    APEX_BatchPool pool;
+    APEX_BatchWorker *workers;
+    int *started;
+    struct timespec start, end;
+    int i;
+
+    if (num_threads <= 0)
+    {
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads > num_jobs)
+    {
+        num_threads = num_jobs;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    pool.run = run;
+    pool.ctx = ctx;
+    pool.num_workers = num_threads;
+    pool.queues = calloc(num_threads, sizeof(APEX_JobQueue));
+    workers = calloc(num_threads, sizeof(APEX_BatchWorker));
+    started = calloc(num_threads, sizeof(int));
+    for (i = 0; pool.queues && i < num_threads; ++i)
+    {
+        pool.queues[i].jobs = malloc(num_jobs * sizeof(int));
+        if (!pool.queues[i].jobs)
+        {
+            break;
+        }
+    }
+    if (!pool.queues || !workers || !started || i < num_threads)
+    {
+        while (pool.queues && i-- > 0)
+        {
+            free(pool.queues[i].jobs);
+        }
+        free(pool.queues);
+        free(workers);
+        free(started);
+        return -1;
+    }
+
+    /* Deal the jobs out round-robin, stealing evens out the rest */
+    for (i = 0; i < num_threads; ++i)
+    {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+    }
+    for (i = 0; i < num_jobs; ++i)
+    {
+        APEX_JobQueue *queue = &pool.queues[i % num_threads];
+        queue->jobs[queue->tail++] = i;
+    }
+
+    for (i = 0; i < num_threads; ++i)
+    {
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        if (log_prefix)
+        {
+            char path[4096];
+
+            snprintf(path, sizeof(path), "%s.%d", log_prefix, i);
+            workers[i].sink = fopen(path, "w");
+        }
+        else
+        {
+            workers[i].sink = fopen("/dev/null", "w");
+        }
+        if (!workers[i].sink)
+        {
+            workers[i].sink = stderr;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    *threads_used = 0;
+    for (i = 0; i < num_threads; ++i)
+    {
+        started[i] = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) == 0;
+        *threads_used += started[i];
+    }
+    if (*threads_used < num_threads)
+    {
+        /* The calling thread */
+        (*threads_used)++;
+    }
+    for (i = 0; i < num_threads; ++i)
+    {
+        if (!started[i])
+        {
+            /* Runs its own queue and steals what the others have left */
+            worker_main(&workers[i]);
+        }
+    }
+    for (i = 0; i < num_threads; ++i)
+    {
+        if (started[i])
+        {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (i = 0; i < num_threads; ++i)
+    {
+        if (workers[i].sink != stderr)
+        {
+            fclose(workers[i].sink);
+        }
+        pthread_mutex_destroy(&pool.queues[i].lock);
+        free(pool.queues[i].jobs);
+    }
+    free(pool.queues);
+    free(workers);
+    free(started);
+    *wall_seconds = elapsed_seconds(&start, &end);
+    return 0;
+}
+
+/* Runs cpu to HALT, or to a fault, in batch mode and records the
+ * outcome */
+static void
+run_cpu(APEX_CPU *cpu, FILE *sink, int worker, APEX_BatchResult *result)
+{
+    struct timespec start, end;
+
+    cpu->out = sink;
+    cpu->diag = sink;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    APEX_cpu_batch(cpu);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result->ok = cpu->status == APEX_STATUS_HALTED;
+    result->faulted = cpu->status == APEX_STATUS_FAULT ||
+                      cpu->status == APEX_STATUS_FETCH_FAULT;
+    result->fetch_fault = cpu->status == APEX_STATUS_FETCH_FAULT;
+    result->fault_pc = result->fetch_fault ? cpu->fetch_fault_pc : cpu->mem_fault_pc;
+    result->fault_address = cpu->mem_fault_address;
+    result->worker = worker;
+    result->cycles = cpu->clock + 1;
+    result->instructions = cpu->insn_completed;
+    result->host_seconds = elapsed_seconds(&start, &end);
+}
+
+static double
+result_cpi(const APEX_BatchResult *result)
+{
+    return result->instructions ? (double)result->cycles / result->instructions : 0.0;
+}
+
+/* How a run ended, for the sweep table */
+static const char *
+result_status(const APEX_BatchResult *result)
+{
+    if (result->invalid)
+    {
+        return "invalid";
+    }
+    if (result->faulted)
+    {
+        return "fault";
+    }
+    return result->ok ? "halted" : "failed";
+}
+
+static void
+run_program_job(void *ctx, int job, int worker, FILE *sink)
+{
+    APEX_ProgramBatch *batch = ctx;
+    APEX_CPU *cpu;
+
+    batch->results[job].worker = worker;
+    fprintf(sink, "==== %s\n", batch->programs[job]);
+    cpu = APEX_cpu_init(batch->programs[job], sink);
+    if (!cpu)
+    {
+        fprintf(sink, "APEX_Error: Unable to initialize CPU for %s\n",
+                batch->programs[job]);
+        return;
+    }
+
+    /* A checkpoint is resumed with the configuration it was taken with */
+    if (!APEX_checkpoint_is_file(batch->programs[job]))
+    {
+        cpu->config = *batch->config;
+    }
+    run_cpu(cpu, sink, worker, &batch->results[job]);
+    APEX_cpu_stop(cpu);
+}
+
+/* Frees the first count entries of programs, and the list itself */
+static void
+free_program_list(char **programs, int count)
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        free(programs[i]);
+    }
+    free(programs);
+}
+
+/*
+ * Reads one program path per line, skipping blank lines.
+ *
+ * Returns the list, or NULL with *count 0 if list_file cannot be read or
+ * lists no program.
+ */
+static char **
+read_program_list(const char *list_file, int *count)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t nread;
+    char **programs = NULL;
+    int capacity = 0;
+    int ok = TRUE;
+
+    *count = 0;
+    fp = fopen(list_file, "r");
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    while ((nread = getline(&line, &len, fp)) != -1)
+    {
+        while (nread > 0 && (line[nread - 1] == '\n' || line[nread - 1] == '\r' ||
+                             line[nread - 1] == ' '))
+        {
+            line[--nread] = '\0';
+        }
+        if (nread == 0)
+        {
+            continue;
+        }
+        if (*count == capacity)
+        {
+            char **grown;
+
+            capacity = capacity ? capacity * 2 : 64;
+            grown = realloc(programs, capacity * sizeof(char *));
+            if (!grown)
+            {
+                ok = FALSE;
+                break;
+            }
+            programs = grown;
+        }
+        programs[*count] = strdup(line);
+        if (!programs[*count])
+        {
+            ok = FALSE;
+            break;
+        }
+        (*count)++;
+    }
+
+    free(line);
+    fclose(fp);
+    if (!ok || !*count)
+    {
+        free_program_list(programs, *count);
+        *count = 0;
+        return NULL;
+    }
+    return programs;
+}
+
+/*
+ * Simulates every program listed in list_file to HALT with config on
+ * num_threads workers and prints one aggregated result table to stdout.
+ * Each worker writes the per-program summaries to its own sink,
+ * <log_prefix>.<worker> if log_prefix is given and discarded otherwise.
+ *
+ * Returns the number of programs that failed to load or stopped on a
+ * memory or fetch fault.
+ */
+int
+APEX_batch_run_programs(const char *list_file, const APEX_Config *config,
+                        int num_threads, const char *log_prefix)
+{
+    APEX_ProgramBatch batch;
+    double wall_seconds;
+    long long total_cycles = 0;
+    int num_programs, failed = 0, faulted = 0;
+    int i;
+
+    batch.programs = read_program_list(list_file, &num_programs);
+    if (!batch.programs)
+    {
+        fprintf(stderr, "APEX_Error: No programs listed in %s\n", list_file);
+        return 1;
+    }
+    batch.config = config;
+    batch.results = calloc(num_programs, sizeof(APEX_BatchResult));
+    if (!batch.results)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the results\n");
+        free_program_list(batch.programs, num_programs);
+        return 1;
+    }
+
+    if (run_pool(num_programs, num_threads, run_program_job, &batch, log_prefix,
+                 &num_threads, &wall_seconds) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the workers\n");
+        free_program_list(batch.programs, num_programs);
+        free(batch.results);
+        return 1;
+    }
+
+    printf("%-40s %12s %12s %8s %10s %6s\n", "Program", "Cycles",
+           "Instructions", "CPI", "Host(s)", "Worker");
+    for (i = 0; i < num_programs; ++i)
+    {
+        const APEX_BatchResult *result = &batch.results[i];
+
+        if (result->fetch_fault)
+        {
+            printf("%-40s %12s at pc(%d) outside code memory\n", batch.programs[i], "FAULT",
+                   result->fault_pc);
+            failed++;
+            faulted++;
+            continue;
+        }
+        if (result->faulted)
+        {
+            printf("%-40s %12s at pc(%d), address %d\n", batch.programs[i], "FAULT",
+                   result->fault_pc, result->fault_address);
+            failed++;
+            faulted++;
+            continue;
+        }
+        if (!result->ok)
+        {
+            printf("%-40s %12s\n", batch.programs[i], "FAILED");
+            failed++;
+            continue;
+        }
+        printf("%-40s %12d %12d %8.3f %10.6f %6d\n", batch.programs[i],
+               result->cycles, result->instructions, result_cpi(result),
+               result->host_seconds, result->worker);
+        total_cycles += result->cycles;
+    }
+    printf("Programs = %d, failed = %d (%d faulted), threads = %d\n", num_programs, failed,
+           faulted, num_threads);
+    printf("Wall clock = %.6f s, simulated cycles/s = %.0f\n", wall_seconds,
+           wall_seconds > 0 ? total_cycles / wall_seconds : 0.0);
+
+    free_program_list(batch.programs, num_programs);
+    free(batch.results);
+    return failed;
+}
+
+/* Selects the configuration of sweep point job, the first parameter varies
+ * slowest */
+static void
+sweep_point_config(const APEX_Sweep *sweep, int job, APEX_Config *config, int *value_index)
+{
+    int i;
+
+    *config = *sweep->base;
+    for (i = sweep->num_params - 1; i >= 0; --i)
+    {
+        value_index[i] = job % sweep->params[i].num_values;
+        job /= sweep->params[i].num_values;
+    }
+    for (i = 0; i < sweep->num_params; ++i)
+    {
+        APEX_config_set(config, sweep->params[i].name,
+                        sweep->params[i].values[value_index[i]]);
+    }
+}
+
+static void
+run_sweep_job(void *ctx, int job, int worker, FILE *sink)
+{
+    APEX_Sweep *sweep = ctx;
+    int value_index[MAX_SWEEP_PARAMS];
+    APEX_Config config;
+    APEX_CPU *cpu;
+
+    if (sweep->results[job].invalid)
+    {
+        return;
+    }
+    sweep_point_config(sweep, job, &config, value_index);
+    cpu = APEX_cpu_init_shared(sweep->code_memory, sweep->code_memory_size);
+    if (!cpu)
+    {
+        return;
+    }
+
+    cpu->config = config;
+    run_cpu(cpu, sink, worker, &sweep->results[job]);
+    APEX_cpu_stop(cpu);
+}
+
+/* Frees the value lists of the parsed sweep parameters */
+static void
+free_sweep_grid(APEX_Sweep *sweep)
+{
+    int i;
+
+    for (i = 0; i < sweep->num_params; ++i)
+    {
+        free(sweep->params[i].values);
+    }
+    sweep->num_params = 0;
+}
+
+/*
+ * Parses a grid "name=v1,v2;name=v1,..." into sweep->params, checking every
+ * value against APEX_config_set.
+ *
+ * Returns the number of points in the grid, 0 on error with nothing left
+ * allocated.
+ */
+static int
+parse_sweep_grid(APEX_Sweep *sweep, char *grid)
+{
+    char *param_save, *value_save;
+    char *param;
+    int num_points = 1;
+
+    for (param = strtok_r(grid, ";", &param_save); param;
+         param = strtok_r(NULL, ";", &param_save))
+    {
+        APEX_SweepParam *p = &sweep->params[sweep->num_params];
+        char *eq = strchr(param, '=');
+        char *value;
+
+        if (!eq || sweep->num_params == MAX_SWEEP_PARAMS)
+        {
+            fprintf(stderr, "APEX_Error: Bad sweep parameter '%s'\n", param);
+            free_sweep_grid(sweep);
+            return 0;
+        }
+        *eq = '\0';
+        p->name = param;
+        p->values = NULL;
+        p->num_values = 0;
+        sweep->num_params++;
+
+        for (value = strtok_r(eq + 1, ",", &value_save); value;
+             value = strtok_r(NULL, ",", &value_save))
+        {
+            APEX_Config check = *sweep->base;
+            char **grown;
+
+            if (APEX_config_set(&check, p->name, value) != 0)
+            {
+                fprintf(stderr, "APEX_Error: Bad sweep value %s=%s\n", p->name, value);
+                free_sweep_grid(sweep);
+                return 0;
+            }
+            grown = realloc(p->values, (p->num_values + 1) * sizeof(char *));
+            if (!grown)
+            {
+                fprintf(stderr, "APEX_Error: Unable to allocate the sweep grid\n");
+                free_sweep_grid(sweep);
+                return 0;
+            }
+            p->values = grown;
+            p->values[p->num_values++] = value;
+        }
+        if (!p->num_values)
+        {
+            fprintf(stderr, "APEX_Error: No values for sweep parameter %s\n", p->name);
+            free_sweep_grid(sweep);
+            return 0;
+        }
+
+        num_points *= p->num_values;
+    }
+    return num_points;
+}
+
+/*
+ * Simulates filename at every point of a configuration grid, for example
+ * "memory_latency=1,2,4;forwarding=0,1;branch_stage=execute,decode", on
+ * num_threads workers. The program is parsed once and its code memory is
+ * shared by all points. One CSV row per point is printed to stdout, its
+ * status column is "halted", "fault" for a memory or fetch fault,
+ * "invalid" for a point whose configuration is invalid, which is not run,
+ * or "failed".
+ *
+ * Returns 0 if every point ran to HALT.
+ */
+int
+APEX_batch_sweep(const char *filename, const char *grid, const APEX_Config *base,
+                 int num_threads)
+{
+    APEX_Sweep sweep;
+    char *grid_copy;
+    double wall_seconds;
+    int num_points, failed = 0;
+    int i, j;
+
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.base = base;
+
+    grid_copy = strdup(grid);
+    num_points = grid_copy ? parse_sweep_grid(&sweep, grid_copy) : 0;
+    if (!num_points)
+    {
+        free(grid_copy);
+        return 1;
+    }
+
+    sweep.code_memory = load_code_memory(filename, &sweep.code_memory_size,
+                                         &sweep.code_memory_map, &sweep.code_memory_map_size,
+                                         stderr);
+    if (!sweep.code_memory)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        free_sweep_grid(&sweep);
+        free(grid_copy);
+        return 1;
+    }
+    sweep.results = calloc(num_points, sizeof(APEX_BatchResult));
+    if (!sweep.results)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the results\n");
+        release_code_memory(sweep.code_memory, sweep.code_memory_map, sweep.code_memory_map_size);
+        free_sweep_grid(&sweep);
+        free(grid_copy);
+        return 1;
+    }
+
+    /* Each value was checked as the grid was parsed, a point can still
+     * combine them into an invalid configuration, such as a cache smaller
+     * than one set of lines */
+    for (i = 0; i < num_points; ++i)
+    {
+        int value_index[MAX_SWEEP_PARAMS];
+        APEX_Config config;
+
+        sweep_point_config(&sweep, i, &config, value_index);
+        sweep.results[i].invalid = !APEX_config_valid(&config) ||
+                                   !APEX_cache_config_valid(&config.dcache) ||
+                                   !APEX_cache_config_valid(&config.icache);
+    }
+
+    if (run_pool(num_points, num_threads, run_sweep_job, &sweep, NULL, &num_threads,
+                 &wall_seconds) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the workers\n");
+        free(sweep.results);
+        release_code_memory(sweep.code_memory, sweep.code_memory_map, sweep.code_memory_map_size);
+        free_sweep_grid(&sweep);
+        free(grid_copy);
+        return 1;
+    }
+
+    for (j = 0; j < sweep.num_params; ++j)
+    {
+        printf("%s,", sweep.params[j].name);
+    }
+    printf("cycles,instructions,cpi,status\n");
+    for (i = 0; i < num_points; ++i)
+    {
+        int value_index[MAX_SWEEP_PARAMS];
+        APEX_Config config;
+
+        sweep_point_config(&sweep, i, &config, value_index);
+        for (j = 0; j < sweep.num_params; ++j)
+        {
+            printf("%s,", sweep.params[j].values[value_index[j]]);
+        }
+        printf("%d,%d,%.4f,%s\n", sweep.results[i].cycles,
+               sweep.results[i].instructions, result_cpi(&sweep.results[i]),
+               result_status(&sweep.results[i]));
+        if (!sweep.results[i].ok)
+        {
+            failed++;
+        }
+    }
+
+    free_sweep_grid(&sweep);
+    free(sweep.results);
+    release_code_memory(sweep.code_memory, sweep.code_memory_map, sweep.code_memory_map_size);
+    free(grid_copy);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * apex_bpred.c
+ * Contains the APEX branch prediction unit consulted by fetch: a direct
+ * mapped branch target buffer and a static, bimodal or gshare direction
+ * predictor, selected by the predictor configuration parameter
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Index of the 2-bit counter for pc */
+static unsigned int
+counter_index(const APEX_CPU *cpu, int pc)
+{
+    unsigned int index = (unsigned int)pc >> 2;
+
+    if (cpu->config.predictor == PREDICTOR_GSHARE)
+    {
+        index ^= cpu->bpred.history;
+    }
+    return index & (cpu->config.bp_entries - 1);
+}
+
+/* Returns the BTB entry for pc, which may hold another branch */
+static APEX_BTBEntry *
+btb_entry(APEX_CPU *cpu, int pc)
+{
+    return &cpu->bpred.btb[((unsigned int)pc >> 2) & (cpu->config.btb_entries - 1)];
+}
+
+/* Clears the predictor, counters start weakly not taken */
+void
+APEX_bp_reset(APEX_CPU *cpu)
+{
+    memset(cpu->bpred.btb, 0, sizeof(cpu->bpred.btb));
+    memset(cpu->bpred.counters, 1, sizeof(cpu->bpred.counters));
+    cpu->bpred.history = 0;
+}
+
+/*
+ * Predicts the instruction after ins at pc, fetch continues from the
+ * returned pc. Only control instructions found in the BTB can be predicted
+ * taken.
+ */
+int
+APEX_bp_predict(APEX_CPU *cpu, int pc, const APEX_Instruction *ins)
+{
+    const APEX_BTBEntry *entry;
+    int taken;
+
+    if (cpu->config.predictor == PREDICTOR_NONE || (unsigned int)ins->opcode >= NUM_OPCODES ||
+        apex_op_table[ins->opcode].ctrl == CTRL_NONE)
+    {
+        return pc + 4;
+    }
+    entry = btb_entry(cpu, pc);
+    if (!entry->valid || entry->pc != pc)
+    {
+        return pc + 4;
+    }
+
+    if (apex_op_table[ins->opcode].cond_flags == 0)
+    {
+        /* Unconditional */
+        taken = TRUE;
+    }
+    else if (cpu->config.predictor == PREDICTOR_STATIC)
+    {
+        /* Backward taken, forward not taken */
+        taken = entry->target <= pc;
+    }
+    else
+    {
+        taken = cpu->bpred.counters[counter_index(cpu, pc)] >= 2;
+    }
+    return taken ? entry->target : pc + 4;
+}
+
+/* Trains the predictor with the resolved outcome of the branch at pc */
+void
+APEX_bp_update(APEX_CPU *cpu, int pc, int taken, int target)
+{
+    APEX_BTBEntry *entry;
+    unsigned char *counter;
+
+    if (cpu->config.predictor == PREDICTOR_NONE)
+    {
+        return;
+    }
+
+    if (taken)
+    {
+        entry = btb_entry(cpu, pc);
+        entry->valid = TRUE;
+        entry->pc = pc;
+        entry->target = target;
+    }
+
+    counter = &cpu->bpred.counters[counter_index(cpu, pc)];
+    if (taken && *counter < 3)
+    {
+        (*counter)++;
+    }
+    else if (!taken && *counter > 0)
+    {
+        (*counter)--;
+    }
+    cpu->bpred.history = ((cpu->bpred.history << 1) | (taken ? 1 : 0)) &
+                         ((1u << cpu->config.history_bits) - 1);
+}
@@ -0,0 +1,271 @@
+/*
+ * apex_cache.c
+ * Contains a set-associative cache timing model. The cache only tracks
+ * tags, the data itself stays in data or code memory, so a cache decides
+ * how many cycles an access takes but never what it returns.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+static int
+is_power_of_two(long value)
+{
+    return value >= 1 && (value & (value - 1)) == 0;
+}
+
+/* Fills config with a disabled cache */
+void
+APEX_cache_config_default(APEX_CacheConfig *config)
+{
+    config->size = 0;
+    config->assoc = 2;
+    config->line_size = 4;
+    config->replacement = CACHE_LRU;
+    config->write_back = TRUE;
+    config->hit_latency = 1;
+    config->miss_latency = 10;
+    config->prefetch = FALSE;
+}
+
+/*
+ * Sets one cache parameter, name is the parameter without its cache
+ * prefix, e.g. "size" for dcache_size.
+ *
+ * Returns 0 on success, -1 for an unknown parameter or invalid value.
+ */
+int
+APEX_cache_config_set(APEX_CacheConfig *config, const char *name, const char *value)
+{
+    if (strcmp(name, "size") == 0)
+    {
+        config->size = atol(value);
+        return config->size == 0 || is_power_of_two(config->size) ? 0 : -1;
+    }
+    if (strcmp(name, "assoc") == 0)
+    {
+        config->assoc = atoi(value);
+        return is_power_of_two(config->assoc) ? 0 : -1;
+    }
+    if (strcmp(name, "line") == 0)
+    {
+        config->line_size = atoi(value);
+        return is_power_of_two(config->line_size) ? 0 : -1;
+    }
+    if (strcmp(name, "replacement") == 0)
+    {
+        if (strcmp(value, "lru") == 0)
+        {
+            config->replacement = CACHE_LRU;
+            return 0;
+        }
+        if (strcmp(value, "random") == 0)
+        {
+            config->replacement = CACHE_RANDOM;
+            return 0;
+        }
+        return -1;
+    }
+    if (strcmp(name, "write") == 0)
+    {
+        if (strcmp(value, "back") == 0 || strcmp(value, "through") == 0)
+        {
+            config->write_back = strcmp(value, "back") == 0;
+            return 0;
+        }
+        return -1;
+    }
+    if (strcmp(name, "hit_latency") == 0)
+    {
+        config->hit_latency = atoi(value);
+        return config->hit_latency >= 1 ? 0 : -1;
+    }
+    if (strcmp(name, "prefetch") == 0)
+    {
+        config->prefetch = atoi(value) != 0;
+        return 0;
+    }
+    if (strcmp(name, "miss_latency") == 0)
+    {
+        config->miss_latency = atoi(value);
+        return config->miss_latency >= 1 ? 0 : -1;
+    }
+    return -1;
+}
+
+/* Returns TRUE unless config describes a cache smaller than one set of
+ * lines, a size of 0 is a disabled cache */
+int
+APEX_cache_config_valid(const APEX_CacheConfig *config)
+{
+    return config->size == 0 || config->size / config->line_size >= config->assoc;
+}
+
+/*
+ * Sets up an empty cache for config. A cache smaller than one set of lines
+ * is rejected.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+APEX_cache_init(APEX_Cache *cache, const APEX_CacheConfig *config)
+{
+    long num_lines = config->size / config->line_size;
+
+    memset(cache, 0, sizeof(*cache));
+    if (num_lines < config->assoc)
+    {
+        return -1;
+    }
+    cache->lines = calloc(num_lines, sizeof(APEX_CacheLine));
+    if (!cache->lines)
+    {
+        return -1;
+    }
+    cache->config = *config;
+    cache->num_sets = num_lines / config->assoc;
+    cache->random_state = 0x9e3779b9u;
+    return 0;
+}
+
+void
+APEX_cache_free(APEX_Cache *cache)
+{
+    free(cache->lines);
+    cache->lines = NULL;
+}
+
+/* Picks the way of set to refill */
+static APEX_CacheLine *
+choose_victim(APEX_Cache *cache, APEX_CacheLine *set)
+{
+    APEX_CacheLine *victim = &set[0];
+    int way;
+
+    for (way = 0; way < cache->config.assoc; ++way)
+    {
+        if (!set[way].valid)
+        {
+            return &set[way];
+        }
+    }
+
+    if (cache->config.replacement == CACHE_RANDOM)
+    {
+        /* xorshift32, deterministic from run to run */
+        cache->random_state ^= cache->random_state << 13;
+        cache->random_state ^= cache->random_state >> 17;
+        cache->random_state ^= cache->random_state << 5;
+        return &set[cache->random_state % cache->config.assoc];
+    }
+
+    for (way = 1; way < cache->config.assoc; ++way)
+    {
+        if (set[way].last_use < victim->last_use)
+        {
+            victim = &set[way];
+        }
+    }
+    return victim;
+}
+
+/* Returns the line holding line_address, or NULL on a miss */
+static APEX_CacheLine *
+find_line(APEX_Cache *cache, unsigned long line_address)
+{
+    unsigned long tag = line_address / cache->num_sets;
+    APEX_CacheLine *set = &cache->lines[(line_address % cache->num_sets) * cache->config.assoc];
+    int way;
+
+    for (way = 0; way < cache->config.assoc; ++way)
+    {
+        if (set[way].valid && set[way].tag == tag)
+        {
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+/* Fills line_address, evicting a line of its set if needed.
+ *
+ * Returns the extra cycles for writing back a dirty victim. */
+static int
+fill_line(APEX_Cache *cache, unsigned long line_address, int dirty)
+{
+    APEX_CacheLine *set = &cache->lines[(line_address % cache->num_sets) * cache->config.assoc];
+    APEX_CacheLine *line = choose_victim(cache, set);
+    int latency = 0;
+
+    if (line->valid)
+    {
+        cache->evictions++;
+        if (line->dirty)
+        {
+            cache->writebacks++;
+            latency = cache->config.miss_latency;
+        }
+    }
+    line->valid = TRUE;
+    line->tag = line_address / cache->num_sets;
+    line->dirty = dirty;
+    line->last_use = cache->accesses;
+    return latency;
+}
+
+/*
+ * Looks up address, a word address, and updates the cache for a read or a
+ * write. A miss fills the line, except for a write to a write-through
+ * cache, which is sent on to memory without allocating. Write-through
+ * writes are buffered and take the hit latency. A write-back cache adds a
+ * second miss latency when the refill evicts a dirty line. With prefetch,
+ * the next line is filled as well if it is missing.
+ *
+ * Returns the cycles the access takes.
+ */
+int
+APEX_cache_access(APEX_Cache *cache, unsigned long address, int is_write)
+{
+    unsigned long line_address = address / cache->config.line_size;
+    APEX_CacheLine *line = find_line(cache, line_address);
+    int latency;
+
+    cache->accesses++;
+    if (line)
+    {
+        cache->hits++;
+        line->last_use = cache->accesses;
+        if (is_write && cache->config.write_back)
+        {
+            line->dirty = TRUE;
+        }
+        latency = cache->config.hit_latency;
+    }
+    else
+    {
+        cache->misses++;
+        if (is_write && !cache->config.write_back)
+        {
+            latency = cache->config.hit_latency;
+        }
+        else
+        {
+            latency = cache->config.miss_latency +
+                      fill_line(cache, line_address, is_write && cache->config.write_back);
+        }
+    }
+
+    /* Next-line prefetch, assumed to complete before the line is used */
+    if (cache->config.prefetch && !find_line(cache, line_address + 1))
+    {
+        cache->prefetches++;
+        fill_line(cache, line_address + 1, FALSE);
+    }
+    return latency;
+}
@@ -0,0 +1,752 @@
+/*
+ * apex_checkpoint.c
+ * Contains functions to save and restore the complete APEX cpu state
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define CHECKPOINT_MAGIC "APXC"
+#define CHECKPOINT_VERSION 13
+
+/* Stage latch as stored in a checkpoint, the instruction is recorded as an
+ * index into code memory instead of a pointer */
+typedef struct APEX_CheckpointLatch
+{
+    int32_t pc;
+    int32_t insn_index;
+    int32_t rs1_value;
+    int32_t rs2_value;
+    int32_t result_buffer;
+    int32_t memory_address;
+    int32_t has_insn;
+    int32_t predicted_pc;
+    int32_t complete_cycle;
+    int32_t rs1_path;
+    int32_t rs2_path;
+    int32_t reserved;
+    int64_t seq;
+} APEX_CheckpointLatch;
+
+/* Cache parameters as stored in a checkpoint */
+typedef struct APEX_CheckpointCache
+{
+    int64_t size;
+    int32_t assoc;
+    int32_t line_size;
+    int32_t replacement;
+    int32_t write_back;
+    int32_t hit_latency;
+    int32_t miss_latency;
+    int32_t prefetch;
+    int32_t reserved;
+} APEX_CheckpointCache;
+
+/* Run-time configuration the checkpoint was taken with, it is resumed with
+ * the same one */
+typedef struct APEX_CheckpointConfig
+{
+    int64_t memory_size;
+    int32_t memory_latency;
+    int32_t forwarding;
+    int32_t branch_stage;
+    int32_t predictor;
+    int32_t btb_entries;
+    int32_t bp_entries;
+    int32_t history_bits;
+    int32_t width;
+    int32_t rf_read_ports;
+    int32_t core;
+    int32_t rob_size;
+    int32_t iq_size;
+    int32_t lsq_size;
+    int32_t phys_regs;
+    int32_t cycle_skip;
+    int32_t reserved;
+    int32_t fu_latency[NUM_FUS];
+    int32_t fu_pipelined[NUM_FUS];
+    APEX_CheckpointCache dcache;
+    APEX_CheckpointCache icache;
+} APEX_CheckpointConfig;
+
+typedef struct APEX_CheckpointBTBEntry
+{
+    int32_t valid;
+    int32_t pc;
+    int32_t target;
+    int32_t reserved;
+} APEX_CheckpointBTBEntry;
+
+/* Branch predictor as stored in a checkpoint, a resumed run predicts the
+ * same way as one that was not interrupted */
+typedef struct APEX_CheckpointPredictor
+{
+    APEX_CheckpointBTBEntry btb[MAX_BTB_ENTRIES];
+    uint8_t counters[MAX_BP_ENTRIES];
+    uint32_t history;
+    uint32_t reserved;
+} APEX_CheckpointPredictor;
+
+/* Contents and statistics of a cache as stored in a checkpoint, its
+ * num_lines lines follow the data memory pages */
+typedef struct APEX_CheckpointCacheState
+{
+    int64_t num_lines; /* 0 if the cache was not set up yet */
+    int64_t accesses;
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t writebacks;
+    int64_t prefetches;
+    uint32_t random_state;
+    uint32_t reserved;
+} APEX_CheckpointCacheState;
+
+typedef struct APEX_CheckpointCacheLine
+{
+    uint64_t tag;
+    uint64_t last_use;
+    int32_t valid;
+    int32_t dirty;
+} APEX_CheckpointCacheLine;
+
+/* APEX_Counters only holds longs, it is stored as an array of them */
+#define CHECKPOINT_COUNTERS (sizeof(APEX_Counters) / sizeof(long))
+
+/* File layout: header, state, num_pages data memory pages, the data and
+ * instruction cache lines, then code_memory_size instructions. All
+ * sections are multiples of 8 bytes so the code memory can be used in
+ * place from the mapping. Only the data memory pages that were allocated
+ * are stored. */
+typedef struct APEX_CheckpointHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t reg_file_size;
+    uint32_t page_words;
+    uint32_t instruction_size;
+    int32_t code_memory_size;
+    int64_t num_pages;
+} APEX_CheckpointHeader;
+
+typedef struct APEX_CheckpointState
+{
+    APEX_CheckpointConfig config;
+    int64_t insn_fast_forwarded;
+    int64_t insn_fetched;
+    int32_t pc;
+    int32_t clock;
+    int32_t insn_completed;
+    int32_t zero_flag;
+    int32_t positive_flag;
+    int32_t negative_flag;
+    int32_t fetch_from_next_cycle;
+    int32_t memory_cycles_left;
+    int32_t fetch_cycles_left;
+    int32_t fu_queue_count;
+    int32_t status;          /* APEX_STATUS_*, a halted program stays halted */
+    int32_t mem_fault;
+    int32_t mem_fault_pc;
+    int32_t mem_fault_address;
+    int32_t fetch_fault;
+    int32_t fetch_fault_pc;
+    int32_t fu_free_cycle[NUM_FUS];
+    int32_t regs[REG_FILE_SIZE];
+    int64_t reg_producer[REG_FILE_SIZE];
+    APEX_CheckpointLatch latches[5];
+    APEX_CheckpointLatch fu_queue[MAX_FU_IN_FLIGHT];
+    APEX_CheckpointPredictor bpred;
+    APEX_CheckpointCacheState dcache;
+    APEX_CheckpointCacheState icache;
+    int64_t counters[CHECKPOINT_COUNTERS];
+} APEX_CheckpointState;
+
+typedef struct APEX_CheckpointPage
+{
+    int64_t page_number;
+    int32_t words[MEM_PAGE_WORDS];
+} APEX_CheckpointPage;
+
+static void
+save_cache(const APEX_CacheConfig *config, APEX_CheckpointCache *cache)
+{
+    cache->size = config->size;
+    cache->assoc = config->assoc;
+    cache->line_size = config->line_size;
+    cache->replacement = config->replacement;
+    cache->write_back = config->write_back;
+    cache->hit_latency = config->hit_latency;
+    cache->miss_latency = config->miss_latency;
+    cache->prefetch = config->prefetch;
+}
+
+static void
+restore_cache(APEX_CacheConfig *config, const APEX_CheckpointCache *cache)
+{
+    config->size = cache->size;
+    config->assoc = cache->assoc;
+    config->line_size = cache->line_size;
+    config->replacement = cache->replacement;
+    config->write_back = cache->write_back;
+    config->hit_latency = cache->hit_latency;
+    config->miss_latency = cache->miss_latency;
+    config->prefetch = cache->prefetch;
+}
+
+static void
+save_config(const APEX_Config *config, APEX_CheckpointConfig *saved)
+{
+    int i;
+
+    saved->memory_size = config->memory_size;
+    saved->memory_latency = config->memory_latency;
+    saved->forwarding = config->forwarding;
+    saved->branch_stage = config->branch_stage;
+    saved->predictor = config->predictor;
+    saved->btb_entries = config->btb_entries;
+    saved->bp_entries = config->bp_entries;
+    saved->history_bits = config->history_bits;
+    saved->width = config->width;
+    saved->rf_read_ports = config->rf_read_ports;
+    saved->core = config->core;
+    saved->rob_size = config->rob_size;
+    saved->iq_size = config->iq_size;
+    saved->lsq_size = config->lsq_size;
+    saved->phys_regs = config->phys_regs;
+    saved->cycle_skip = config->cycle_skip;
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        saved->fu_latency[i] = config->fu[i].latency;
+        saved->fu_pipelined[i] = config->fu[i].pipelined;
+    }
+    save_cache(&config->dcache, &saved->dcache);
+    save_cache(&config->icache, &saved->icache);
+}
+
+static void
+restore_config(APEX_Config *config, const APEX_CheckpointConfig *saved)
+{
+    int i;
+
+    config->memory_size = saved->memory_size;
+    config->memory_latency = saved->memory_latency;
+    config->forwarding = saved->forwarding;
+    config->branch_stage = saved->branch_stage;
+    config->predictor = saved->predictor;
+    config->btb_entries = saved->btb_entries;
+    config->bp_entries = saved->bp_entries;
+    config->history_bits = saved->history_bits;
+    config->width = saved->width;
+    config->rf_read_ports = saved->rf_read_ports;
+    config->core = saved->core;
+    config->rob_size = saved->rob_size;
+    config->iq_size = saved->iq_size;
+    config->lsq_size = saved->lsq_size;
+    config->phys_regs = saved->phys_regs;
+    config->cycle_skip = saved->cycle_skip;
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        config->fu[i].latency = saved->fu_latency[i];
+        config->fu[i].pipelined = saved->fu_pipelined[i];
+    }
+    restore_cache(&config->dcache, &saved->dcache);
+    restore_cache(&config->icache, &saved->icache);
+}
+
+static void
+save_predictor(const APEX_BranchPredictor *bpred, APEX_CheckpointPredictor *saved)
+{
+    int i;
+
+    for (i = 0; i < MAX_BTB_ENTRIES; ++i)
+    {
+        saved->btb[i].valid = bpred->btb[i].valid;
+        saved->btb[i].pc = bpred->btb[i].pc;
+        saved->btb[i].target = bpred->btb[i].target;
+    }
+    memcpy(saved->counters, bpred->counters, sizeof(saved->counters));
+    saved->history = bpred->history;
+}
+
+/* Returns TRUE if every counter of the stored predictor is a 2-bit one */
+static int
+predictor_valid(const APEX_CheckpointPredictor *saved)
+{
+    int i;
+
+    for (i = 0; i < MAX_BP_ENTRIES; ++i)
+    {
+        if (saved->counters[i] > 3)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* The predictor must have been checked by predictor_valid */
+static void
+restore_predictor(APEX_BranchPredictor *bpred, const APEX_CheckpointPredictor *saved)
+{
+    int i;
+
+    for (i = 0; i < MAX_BTB_ENTRIES; ++i)
+    {
+        bpred->btb[i].valid = saved->btb[i].valid != 0;
+        bpred->btb[i].pc = saved->btb[i].pc;
+        bpred->btb[i].target = saved->btb[i].target;
+    }
+    memcpy(bpred->counters, saved->counters, sizeof(bpred->counters));
+    bpred->history = saved->history;
+}
+
+static long
+cache_num_lines(const APEX_Cache *cache)
+{
+    return cache->lines ? cache->num_sets * cache->config.assoc : 0;
+}
+
+static void
+save_cache_contents(const APEX_Cache *cache, APEX_CheckpointCacheState *saved)
+{
+    saved->num_lines = cache_num_lines(cache);
+    saved->accesses = cache->accesses;
+    saved->hits = cache->hits;
+    saved->misses = cache->misses;
+    saved->evictions = cache->evictions;
+    saved->writebacks = cache->writebacks;
+    saved->prefetches = cache->prefetches;
+    saved->random_state = cache->random_state;
+}
+
+/* Returns TRUE if the lines of cache were written to fp */
+static int
+write_cache_lines(const APEX_Cache *cache, FILE *fp)
+{
+    APEX_CheckpointCacheLine line;
+    long i;
+
+    memset(&line, 0, sizeof(line));
+    for (i = 0; i < cache_num_lines(cache); ++i)
+    {
+        line.tag = cache->lines[i].tag;
+        line.last_use = cache->lines[i].last_use;
+        line.valid = cache->lines[i].valid;
+        line.dirty = cache->lines[i].dirty;
+        if (fwrite(&line, sizeof(line), 1, fp) != 1)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Returns TRUE if the stored cache was not set up or has the number of
+ * lines of config, which must be a valid configuration */
+static int
+cache_contents_valid(const APEX_CheckpointCacheState *saved, const APEX_CacheConfig *config)
+{
+    return saved->num_lines == 0 ||
+           (config->size && saved->num_lines == config->size / config->line_size);
+}
+
+/*
+ * Sets up cache for config with the stored lines and statistics, the state
+ * must have been checked by cache_contents_valid.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+restore_cache_contents(APEX_Cache *cache, const APEX_CacheConfig *config,
+                       const APEX_CheckpointCacheState *saved,
+                       const APEX_CheckpointCacheLine *lines)
+{
+    long i;
+
+    if (saved->num_lines == 0)
+    {
+        return 0;
+    }
+    if (APEX_cache_init(cache, config) != 0)
+    {
+        return -1;
+    }
+    for (i = 0; i < saved->num_lines; ++i)
+    {
+        if ((lines[i].valid != 0 && lines[i].valid != 1) ||
+            (lines[i].dirty != 0 && lines[i].dirty != 1))
+        {
+            return -1;
+        }
+        cache->lines[i].tag = lines[i].tag;
+        cache->lines[i].last_use = lines[i].last_use;
+        cache->lines[i].valid = lines[i].valid;
+        cache->lines[i].dirty = lines[i].dirty;
+    }
+    cache->accesses = saved->accesses;
+    cache->hits = saved->hits;
+    cache->misses = saved->misses;
+    cache->evictions = saved->evictions;
+    cache->writebacks = saved->writebacks;
+    cache->prefetches = saved->prefetches;
+    cache->random_state = saved->random_state;
+    return 0;
+}
+
+/* Undoes a restore that failed after code memory was set up */
+static void
+release_restored(APEX_CPU *cpu, void *map, size_t map_size)
+{
+    APEX_mem_release(cpu);
+    APEX_cache_free(&cpu->dcache);
+    APEX_cache_free(&cpu->icache);
+    cpu->code_memory = NULL;
+    cpu->code_memory_map = NULL;
+    munmap(map, map_size);
+}
+
+static void
+save_latch(const APEX_CPU *cpu, const CPU_Stage *stage, APEX_CheckpointLatch *latch)
+{
+    latch->pc = stage->pc;
+    latch->insn_index = stage->insn ? (int32_t)(stage->insn - cpu->code_memory) : -1;
+    latch->rs1_value = stage->rs1_value;
+    latch->rs2_value = stage->rs2_value;
+    latch->result_buffer = stage->result_buffer;
+    latch->memory_address = stage->memory_address;
+    latch->has_insn = stage->has_insn;
+    latch->predicted_pc = stage->predicted_pc;
+    latch->complete_cycle = stage->complete_cycle;
+    latch->rs1_path = stage->rs1_path;
+    latch->rs2_path = stage->rs2_path;
+    latch->seq = stage->seq;
+}
+
+/* Returns TRUE if the latch refers to no instruction or to one in code
+ * memory. A latch holding an instruction must refer to it, except in fetch
+ * where has_insn only means fetching is enabled. */
+static int
+latch_valid(const APEX_CheckpointLatch *latch, int code_memory_size, int is_fetch)
+{
+    if (latch->insn_index < 0)
+    {
+        return latch->insn_index == -1 && (is_fetch || !latch->has_insn);
+    }
+    return latch->insn_index < code_memory_size;
+}
+
+/* Returns TRUE if every latch of state is valid */
+static int
+latches_valid(const APEX_CheckpointState *state, int code_memory_size)
+{
+    int i;
+
+    for (i = 0; i < 5; ++i)
+    {
+        if (!latch_valid(&state->latches[i], code_memory_size, i == 0))
+        {
+            return FALSE;
+        }
+    }
+    for (i = 0; i < MAX_FU_IN_FLIGHT; ++i)
+    {
+        if (!latch_valid(&state->fu_queue[i], code_memory_size, FALSE))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* The latch must have been checked by latch_valid */
+static void
+restore_latch(const APEX_CPU *cpu, CPU_Stage *stage, const APEX_CheckpointLatch *latch)
+{
+    stage->pc = latch->pc;
+    stage->insn = latch->insn_index >= 0 ? &cpu->code_memory[latch->insn_index] : NULL;
+    stage->rs1_value = latch->rs1_value;
+    stage->rs2_value = latch->rs2_value;
+    stage->result_buffer = latch->result_buffer;
+    stage->memory_address = latch->memory_address;
+    stage->has_insn = latch->has_insn;
+    stage->predicted_pc = latch->predicted_pc;
+    stage->complete_cycle = latch->complete_cycle;
+    stage->rs1_path = latch->rs1_path;
+    stage->rs2_path = latch->rs2_path;
+    stage->seq = latch->seq;
+}
+
+/* Returns TRUE if filename starts with the checkpoint magic */
+int
+APEX_checkpoint_is_file(const char *filename)
+{
+    char magic[4];
+    FILE *fp = fopen(filename, "rb");
+    int is_checkpoint;
+
+    if (!fp)
+    {
+        return FALSE;
+    }
+    is_checkpoint = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+                    memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return is_checkpoint;
+}
+
+/*
+ * Writes the complete cpu state, including code memory and the run-time
+ * configuration, to filename. Only the scalar in-order pipeline,
+ * config.width 1, is saved.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+APEX_checkpoint_save(const APEX_CPU *cpu, const char *filename)
+{
+    APEX_CheckpointHeader header;
+    APEX_CheckpointState state;
+    APEX_CheckpointPage page;
+    const CPU_Stage *stages[5] = {&cpu->fetch, &cpu->decode, &cpu->execute,
+                                  &cpu->memory, &cpu->writeback};
+    const int *words;
+    long page_number;
+    FILE *fp;
+    int i, ok;
+
+    if (cpu->config.width > 1 || cpu->config.core != CORE_INORDER)
+    {
+        fprintf(cpu->diag, "APEX_Error: Checkpoints are only supported for the scalar in-order pipeline\n");
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.reg_file_size = REG_FILE_SIZE;
+    header.page_words = MEM_PAGE_WORDS;
+    header.instruction_size = sizeof(APEX_Instruction);
+    header.code_memory_size = cpu->code_memory_size;
+    header.num_pages = cpu->data_memory.num_pages;
+
+    memset(&state, 0, sizeof(state));
+    save_config(&cpu->config, &state.config);
+    state.insn_fast_forwarded = cpu->insn_fast_forwarded;
+    state.insn_fetched = cpu->insn_fetched;
+    state.pc = cpu->pc;
+    state.clock = cpu->clock;
+    state.insn_completed = cpu->insn_completed;
+    state.zero_flag = cpu->zero_flag;
+    state.positive_flag = cpu->positive_flag;
+    state.negative_flag = cpu->negative_flag;
+    state.fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    state.memory_cycles_left = cpu->memory_cycles_left;
+    state.fetch_cycles_left = cpu->fetch_cycles_left;
+    state.fu_queue_count = cpu->fu_queue_count;
+    state.status = cpu->status;
+    state.mem_fault = cpu->mem_fault;
+    state.mem_fault_pc = cpu->mem_fault_pc;
+    state.mem_fault_address = cpu->mem_fault_address;
+    state.fetch_fault = cpu->fetch_fault;
+    state.fetch_fault_pc = cpu->fetch_fault_pc;
+    memcpy(state.fu_free_cycle, cpu->fu_free_cycle, sizeof(state.fu_free_cycle));
+    memcpy(state.regs, cpu->regs, sizeof(state.regs));
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        state.reg_producer[i] = cpu->reg_producer[i];
+    }
+    for (i = 0; i < 5; ++i)
+    {
+        save_latch(cpu, stages[i], &state.latches[i]);
+    }
+    for (i = 0; i < MAX_FU_IN_FLIGHT; ++i)
+    {
+        save_latch(cpu, &cpu->fu_queue[i], &state.fu_queue[i]);
+    }
+    save_predictor(&cpu->bpred, &state.bpred);
+    save_cache_contents(&cpu->dcache, &state.dcache);
+    save_cache_contents(&cpu->icache, &state.icache);
+    for (i = 0; i < (int)CHECKPOINT_COUNTERS; ++i)
+    {
+        state.counters[i] = ((const long *)&cpu->counters)[i];
+    }
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        return -1;
+    }
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(&state, sizeof(state), 1, fp) == 1;
+    page_number = 0;
+    while (ok && (words = APEX_mem_next_page(cpu, &page_number)) != NULL)
+    {
+        page.page_number = page_number++;
+        memcpy(page.words, words, sizeof(page.words));
+        ok = fwrite(&page, sizeof(page), 1, fp) == 1;
+    }
+    ok = ok && write_cache_lines(&cpu->dcache, fp) && write_cache_lines(&cpu->icache, fp);
+    ok = ok &&
+         fwrite(cpu->code_memory, sizeof(APEX_Instruction), cpu->code_memory_size, fp) ==
+             (size_t)cpu->code_memory_size;
+    if (fclose(fp) != 0)
+    {
+        ok = FALSE;
+    }
+    return ok ? 0 : -1;
+}
+
+/*
+ * Restores cpu from a checkpoint written by APEX_checkpoint_save. The file
+ * is mapped and code memory is used in place from the mapping, the mapping
+ * is released by APEX_cpu_stop. cpu->config is replaced by the
+ * configuration the checkpoint was taken with.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+APEX_checkpoint_restore(APEX_CPU *cpu, const char *filename)
+{
+    const APEX_CheckpointHeader *header;
+    const APEX_CheckpointState *state;
+    const APEX_CheckpointPage *pages;
+    const APEX_CheckpointCacheLine *lines;
+    const APEX_Instruction *code_memory;
+    APEX_Config config;
+    CPU_Stage *stages[5] = {&cpu->fetch, &cpu->decode, &cpu->execute,
+                            &cpu->memory, &cpu->writeback};
+    struct stat st;
+    size_t expected;
+    void *map;
+    int fd;
+    long i;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header) + sizeof(*state))
+    {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    header = map;
+    state = (const APEX_CheckpointState *)(header + 1);
+    pages = (const APEX_CheckpointPage *)(state + 1);
+    lines = (const APEX_CheckpointCacheLine *)(pages + header->num_pages);
+    code_memory = (const APEX_Instruction *)(lines + state->dcache.num_lines +
+                                             state->icache.num_lines);
+    expected = sizeof(*header) + sizeof(*state) +
+               (size_t)header->num_pages * sizeof(APEX_CheckpointPage) +
+               (size_t)(state->dcache.num_lines + state->icache.num_lines) *
+                   sizeof(APEX_CheckpointCacheLine) +
+               (size_t)header->code_memory_size * sizeof(APEX_Instruction);
+    config = cpu->config;
+    restore_config(&config, &state->config);
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CHECKPOINT_VERSION ||
+        header->reg_file_size != REG_FILE_SIZE ||
+        header->page_words != MEM_PAGE_WORDS ||
+        header->num_pages < 0 || header->num_pages > MEM_DIR_ENTRIES * MEM_TABLE_ENTRIES ||
+        header->instruction_size != sizeof(APEX_Instruction) ||
+        header->code_memory_size <= 0 || (size_t)st.st_size != expected ||
+        state->fu_queue_count < 0 || state->fu_queue_count > MAX_FU_IN_FLIGHT ||
+        (state->status != APEX_STATUS_RUNNING && state->status != APEX_STATUS_HALTED &&
+         state->status != APEX_STATUS_FAULT && state->status != APEX_STATUS_FETCH_FAULT) ||
+        !latches_valid(state, header->code_memory_size) || !predictor_valid(&state->bpred) ||
+        !APEX_config_valid(&config) || config.width != 1 || config.core != CORE_INORDER ||
+        !cache_contents_valid(&state->dcache, &config.dcache) ||
+        !cache_contents_valid(&state->icache, &config.icache))
+    {
+        fprintf(cpu->diag, "APEX_Error: %s is not a compatible checkpoint\n", filename);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    if (validate_code_memory(code_memory, header->code_memory_size, filename, cpu->diag) != 0)
+    {
+        fprintf(cpu->diag, "APEX_Error: %s has invalid code memory\n", filename);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    cpu->code_memory = (APEX_Instruction *)code_memory;
+    cpu->code_memory_size = header->code_memory_size;
+    cpu->code_memory_map = map;
+    cpu->code_memory_map_size = st.st_size;
+
+    cpu->config = config;
+    cpu->insn_fast_forwarded = state->insn_fast_forwarded;
+    cpu->insn_fetched = state->insn_fetched;
+    cpu->pc = state->pc;
+    cpu->clock = state->clock;
+    cpu->insn_completed = state->insn_completed;
+    cpu->zero_flag = state->zero_flag;
+    cpu->positive_flag = state->positive_flag;
+    cpu->negative_flag = state->negative_flag;
+    cpu->fetch_from_next_cycle = state->fetch_from_next_cycle;
+    cpu->memory_cycles_left = state->memory_cycles_left;
+    cpu->fetch_cycles_left = state->fetch_cycles_left;
+    cpu->fu_queue_count = state->fu_queue_count;
+    cpu->status = state->status;
+    cpu->mem_fault = state->mem_fault;
+    cpu->mem_fault_pc = state->mem_fault_pc;
+    cpu->mem_fault_address = state->mem_fault_address;
+    cpu->fetch_fault = state->fetch_fault;
+    cpu->fetch_fault_pc = state->fetch_fault_pc;
+    memcpy(cpu->fu_free_cycle, state->fu_free_cycle, sizeof(cpu->fu_free_cycle));
+    memcpy(cpu->regs, state->regs, sizeof(cpu->regs));
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        cpu->reg_producer[i] = state->reg_producer[i];
+    }
+    for (i = 0; i < 5; ++i)
+    {
+        restore_latch(cpu, stages[i], &state->latches[i]);
+    }
+    for (i = 0; i < MAX_FU_IN_FLIGHT; ++i)
+    {
+        restore_latch(cpu, &cpu->fu_queue[i], &state->fu_queue[i]);
+    }
+    restore_predictor(&cpu->bpred, &state->bpred);
+    for (i = 0; i < (long)CHECKPOINT_COUNTERS; ++i)
+    {
+        ((long *)&cpu->counters)[i] = state->counters[i];
+    }
+    for (i = 0; i < header->num_pages; ++i)
+    {
+        if (APEX_mem_load_page(cpu, pages[i].page_number, pages[i].words) != 0)
+        {
+            fprintf(cpu->diag, "APEX_Error: %s has an invalid data memory page\n", filename);
+            release_restored(cpu, map, st.st_size);
+            return -1;
+        }
+    }
+    if (restore_cache_contents(&cpu->dcache, &config.dcache, &state->dcache, lines) != 0 ||
+        restore_cache_contents(&cpu->icache, &config.icache, &state->icache,
+                               lines + state->dcache.num_lines) != 0)
+    {
+        fprintf(cpu->diag, "APEX_Error: %s has invalid cache contents\n", filename);
+        release_restored(cpu, map, st.st_size);
+        return -1;
+    }
+    return 0;
+}
@@ -6,6 +6,7 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,140 +25,204 @@ get_code_memory_index_from_pc(const int pc)
     return (pc - 4000) / 4;
 }
 
+/* Debug function which prints the CPU stage content
+ *
+ * Note: You can edit this function to print in more detail
+ */
 static void
-print_instruction(const CPU_Stage *stage)
+print_stage_content(FILE *out, const char *name, const CPU_Stage *stage)
 {
-    switch (stage->opcode)
-    {
-    case OPCODE_ADD:
-    case OPCODE_SUB:
-    case OPCODE_MUL:
-    case OPCODE_AND:
-    case OPCODE_OR:
-    case OPCODE_XOR:
-    {
-        printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-               stage->rs2);
-        break;
-    }
-    case OPCODE_ADDL:
-    case OPCODE_SUBL:
-    case OPCODE_JALR:
-    {
-        printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-               stage->imm);
-        break;
-    }
+    fprintf(out, "%-15s: pc(%d) ", name, stage->pc);
+    print_instruction(out, stage->insn);
+    fprintf(out, "\n");
+}
+
+/* Records a trace event for the cycle being simulated */
+void
+APEX_trace_event(APEX_CPU *cpu, int stage_id, int event, const CPU_Stage *stage, int aux)
+{
+    APEX_TraceRecord *record;
 
-    case OPCODE_MOVC:
+    if (cpu->clock + 1 < cpu->trace->first_cycle || cpu->clock + 1 > cpu->trace->last_cycle)
     {
-        printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
-        break;
+        return;
     }
-
-    case OPCODE_LOAD:
-    case OPCODE_LOADP:
+    if (cpu->trace->count == TRACE_BUFFER_RECORDS)
     {
-        printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-               stage->imm);
-        break;
+        APEX_trace_flush(cpu->trace);
     }
+    record = &cpu->trace->records[cpu->trace->count++];
+    record->cycle = cpu->clock + 1;
+    record->pc = stage->pc;
+    record->seq = (uint32_t)stage->seq;
+    record->stage = stage_id;
+    record->event = event;
+    record->aux = aux;
+    record->reserved = 0;
+}
 
-    case OPCODE_STORE:
-    case OPCODE_STOREP:
+/* Reports that stage processed or held its instruction this cycle, to the
+ * debug output and the trace */
+void
+APEX_stage_event(APEX_CPU *cpu, int stage_id, const CPU_Stage *stage)
+{
+    if (ENABLE_DEBUG_MESSAGES && cpu->debug_messages)
     {
-        printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-               stage->imm);
-        break;
+        print_stage_content(cpu->out, apex_stage_titles[stage_id], stage);
     }
-    case OPCODE_CML:
-    case OPCODE_JUMP:
+    if (cpu->trace)
     {
-        printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
-        break;
+        APEX_trace_event(cpu, stage_id, TRACE_STAGE, stage, 0);
     }
-    case OPCODE_CMP:
+}
+
+/* Returns the code memory index of the instruction at pc, or -1 when pc is
+ * not the address of one of the program's instructions */
+int
+APEX_code_index(const APEX_CPU *cpu, int pc)
+{
+    if (pc < 4000 || (pc - 4000) % 4 != 0 ||
+        get_code_memory_index_from_pc(pc) >= cpu->code_memory_size)
     {
-        printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
-        break;
+        return -1;
     }
+    return get_code_memory_index_from_pc(pc);
+}
 
-    case OPCODE_BZ:
-    case OPCODE_BNZ:
-    case OPCODE_BP:
-    case OPCODE_BNP:
-    case OPCODE_BN:
-    case OPCODE_BNN:
+/*
+ * Called by each core at the end of a cycle. Fetch does not go past the
+ * end of code memory or to a pc outside it, it waits there as a branch
+ * still in the core may redirect it. Once drained says the core holds no
+ * older instruction, nothing can and the program stops with a fetch fault.
+ *
+ * Returns TRUE if the fetch fault was recorded.
+ */
+int
+APEX_fetch_faulted(APEX_CPU *cpu, int drained)
+{
+    if (!drained || !cpu->fetch.has_insn || cpu->fetch_from_next_cycle ||
+        APEX_code_index(cpu, cpu->pc) >= 0)
     {
-        printf("%s,#%d ", stage->opcode_str, stage->imm);
-        break;
+        return FALSE;
     }
+    cpu->fetch_fault = TRUE;
+    cpu->fetch_fault_pc = cpu->pc;
+    return TRUE;
+}
 
-    case OPCODE_HALT:
-    case OPCODE_NOP:
+/* Returns the profile entry of the instruction at pc, or NULL when not
+ * profiling or pc is outside code memory */
+APEX_PcProfile *
+APEX_profile_entry(const APEX_CPU *cpu, int pc)
+{
+    int index = APEX_code_index(cpu, pc);
+
+    if (!cpu->profile || index < 0)
     {
-        printf("%s ", stage->opcode_str);
-        break;
-    }
+        return NULL;
     }
+    return &cpu->profile[index];
 }
 
-/* Debug function which prints the CPU stage content
- *
- * Note: You can edit this function to print in more detail
- */
-static void
-print_stage_content(const char *name, const CPU_Stage *stage)
+/* Increments a profile count, noting it while the cycle is recorded to be
+ * repeated over skipped cycles */
+void
+APEX_profile_count(APEX_CPU *cpu, long *count)
 {
-    printf("%-15s: pc(%d) ", name, stage->pc);
-    print_instruction(stage);
-    printf("\n");
+    (*count)++;
+    if (cpu->skip_recording)
+    {
+        if (cpu->skip_profile_count < MAX_SKIP_PROFILE)
+        {
+            cpu->skip_profile[cpu->skip_profile_count] = count;
+        }
+        cpu->skip_profile_count++;
+    }
 }
 
-/* Debug function which prints the register file
- *
- * Note: You are not supposed to edit this function
- */
-static void
-print_reg_file(const APEX_CPU *cpu)
+/* Counts a cycle in which stage held its instruction for cause */
+void
+APEX_count_stall(APEX_CPU *cpu, int cause, int stage_id, const CPU_Stage *stage)
 {
-    int i;
+    APEX_PcProfile *entry = APEX_profile_entry(cpu, stage->pc);
 
-    printf("----------\n%s\n----------\n", "Registers:");
-
-    for (int i = 0; i < REG_FILE_SIZE / 2; ++i)
+    cpu->counters.stalls[cause]++;
+    if (entry)
+    {
+        APEX_profile_count(cpu, &entry->stalls);
+    }
+    if (cpu->trace)
     {
-        printf("R%-1d[%-1d] ", i, cpu->regs[i]);
+        APEX_trace_event(cpu, stage_id, TRACE_STALL, stage, cause);
     }
+    APEX_OBSERVE(cpu, APEX_EVENT_STALL, stage_id, stage, cause, 0, 0);
+}
 
-    printf("\n");
+/* Delivers an event of the cycle being simulated to the observers
+ * registered for it, called through APEX_OBSERVE */
+void
+APEX_observer_event(APEX_CPU *cpu, int type, int stage_id, const CPU_Stage *stage, int detail,
+                    int address, int value)
+{
+    apex_event event;
+    int i;
 
-    for (i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
+    event.type = type;
+    event.cycle = cpu->clock + 1;
+    event.pc = stage->pc;
+    event.seq = stage->seq;
+    event.stage = stage_id;
+    event.detail = detail;
+    event.address = address;
+    event.value = value;
+    for (i = 0; i < MAX_OBSERVERS; ++i)
     {
-        printf("R%-1d[%-1d] ", i, cpu->regs[i]);
+        if (cpu->observers[i].events & type)
+        {
+            cpu->observers[i].fn(cpu, &event, cpu->observers[i].arg);
+        }
     }
-
-    printf("\n");
 }
+
+/* Charges the cycle about to be simulated to the oldest instruction in the
+ * pipeline, or to the fetch PC when the pipeline is empty */
 static void
-print_data_memory(APEX_CPU *cpu)
+profile_cycle(APEX_CPU *cpu)
 {
-    int start = 0, count = 0;
-    while (start < DATA_MEMORY_SIZE)
-    {
+    const CPU_Stage *oldest[5] = {&cpu->writeback, &cpu->memory, &cpu->fu_queue[0],
+                                  &cpu->execute, &cpu->decode};
+    APEX_PcProfile *entry = NULL;
+    int i;
 
-        if (cpu->data_memory[start] != 0)
+    for (i = 0; i < 5 && !entry; ++i)
+    {
+        if (oldest[i]->has_insn)
         {
-            printf("MEM[%d] = %d\n", start, cpu->data_memory[start]);
-            count++;
+            entry = APEX_profile_entry(cpu, oldest[i]->pc);
         }
-        start++;
     }
-    if (count == 0)
+    if (!entry && cpu->fetch.has_insn)
+    {
+        entry = APEX_profile_entry(cpu, cpu->pc);
+    }
+    if (entry)
+    {
+        APEX_profile_count(cpu, &entry->cycles);
+    }
+}
+
+/* Returns the cycles fetching the instruction at pc takes */
+int
+APEX_fetch_latency(APEX_CPU *cpu, int pc)
+{
+    if (!cpu->icache.lines && APEX_cache_init(&cpu->icache, &cpu->config.icache) != 0)
     {
-        printf("All the memory values are zeros\n");
+        cpu->config.icache.size = 0;
+        return 1;
     }
+    return APEX_cache_access(&cpu->icache, (unsigned int)get_code_memory_index_from_pc(pc), FALSE);
 }
+
 /*
  * Fetch Stage of APEX Pipeline
  *
@@ -166,7 +231,7 @@ print_data_memory(APEX_CPU *cpu)
 static void
 APEX_fetch(APEX_CPU *cpu)
 {
-    APEX_Instruction *current_ins;
+    int moved;
 
     if (cpu->fetch.has_insn)
     {
@@ -174,44 +239,251 @@ APEX_fetch(APEX_CPU *cpu)
         if (cpu->fetch_from_next_cycle == TRUE)
         {
             cpu->fetch_from_next_cycle = FALSE;
+            cpu->counters.fetch_bubbles++;
 
             /* Skip this cycle*/
             return;
         }
 
+        /* Nothing is fetched outside code memory, see APEX_fetch_faulted */
+        if (APEX_code_index(cpu, cpu->pc) < 0)
+        {
+            return;
+        }
+
         /* Store current PC in fetch latch */
         cpu->fetch.pc = cpu->pc;
 
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.imm = current_ins->imm;
-        if (cpu->stall_flag == 0)
+        /* Index into code memory using this pc, the latch only references the
+         * pre-decoded instruction */
+        cpu->fetch.insn = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
+
+        /* Pick the next pc, a predicted taken branch continues at its target */
+        cpu->fetch.predicted_pc = cpu->config.predictor == PREDICTOR_NONE
+                                      ? cpu->pc + 4
+                                      : APEX_bp_predict(cpu, cpu->pc, cpu->fetch.insn);
+
+        /* Number the instruction the first cycle it is fetched, which is
+         * also when it is looked up in the instruction cache */
+        if (cpu->fetch.seq == 0)
+        {
+            cpu->fetch.seq = ++cpu->insn_fetched;
+            if (cpu->config.icache.size)
+            {
+                cpu->fetch_cycles_left = APEX_fetch_latency(cpu, cpu->pc) - 1;
+            }
+        }
+
+        /* Wait for an instruction cache miss */
+        if (cpu->fetch_cycles_left > 0)
+        {
+            cpu->fetch_cycles_left--;
+            APEX_count_stall(cpu, STALL_ICACHE, STAGE_FETCH, &cpu->fetch);
+            APEX_stage_event(cpu, STAGE_FETCH, &cpu->fetch);
+            return;
+        }
+
+        /* Decode still holds its instruction when it is stalled */
+        moved = !cpu->decode.has_insn;
+        if (moved)
         {
             /* Update PC for next instruction */
-            cpu->pc += 4;
+            cpu->pc = cpu->fetch.predicted_pc;
             /* Copy data from fetch latch to decode latch*/
             cpu->decode = cpu->fetch;
-            if (cpu->fetch.opcode == OPCODE_HALT)
+            APEX_OBSERVE(cpu, APEX_EVENT_FETCH, STAGE_FETCH, &cpu->decode, 0, 0, 0);
+            if (cpu->fetch.insn->opcode == OPCODE_HALT)
             {
                 cpu->fetch.has_insn = FALSE;
             }
         }
 
-        if (ENABLE_DEBUG_MESSAGES)
+        APEX_stage_event(cpu, STAGE_FETCH, &cpu->fetch);
+        if (moved)
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            cpu->fetch.seq = 0;
         }
 
         /* Stop fetching new instructions if HALT is fetched */
     }
 }
 
+/* Redirects fetch to the correct pc after the branch in the execute latch
+ * and flushes the younger instruction in decode */
+static void
+redirect_fetch(APEX_CPU *cpu, int target)
+{
+    APEX_PcProfile *entry = APEX_profile_entry(cpu, cpu->execute.pc);
+
+    if (cpu->decode.has_insn)
+    {
+        cpu->counters.flushed++;
+    }
+    if (entry)
+    {
+        /* The squashed instruction in decode and the skipped fetch */
+        entry->flushes += cpu->decode.has_insn + 1;
+    }
+    if (cpu->trace)
+    {
+        APEX_trace_event(cpu, cpu->config.branch_stage == BRANCH_STAGE_DECODE ? STAGE_DECODE : STAGE_EXECUTE,
+                    TRACE_FLUSH, &cpu->execute, cpu->decode.has_insn);
+    }
+    APEX_OBSERVE(cpu, APEX_EVENT_FLUSH,
+                 cpu->config.branch_stage == BRANCH_STAGE_DECODE ? STAGE_DECODE : STAGE_EXECUTE,
+                 &cpu->execute, cpu->decode.has_insn, target, 0);
+
+    /* Calculate new PC, and send it to fetch unit */
+    cpu->pc = target;
+
+    /* Since we are using reverse callbacks for pipeline stages,
+     * this will prevent the new instruction from being fetched in the current cycle*/
+    cpu->fetch_from_next_cycle = TRUE;
+
+    /* Flush previous stages */
+    cpu->decode.has_insn = FALSE;
+    cpu->fetch.seq = 0;
+    cpu->fetch_cycles_left = 0;
+
+    /* Make sure fetch stage is enabled to start fetching from new PC */
+    cpu->fetch.has_insn = TRUE;
+}
+
+/* Resolves the control instruction in branch, taken or not, and trains the
+ * predictor. Returns the pc execution continues at, which fetch mispredicted
+ * unless it is branch->predicted_pc. */
+int
+APEX_resolve_branch(APEX_CPU *cpu, const CPU_Stage *branch, const APEX_OpInfo *op, int taken)
+{
+    int target = (op->ctrl == CTRL_REG ? branch->rs1_value : branch->pc) + branch->insn->imm;
+    int next_pc = taken ? target : branch->pc + 4;
+
+    cpu->counters.branches++;
+    if (taken)
+    {
+        cpu->counters.taken_branches++;
+    }
+    APEX_bp_update(cpu, branch->pc, taken, target);
+
+    if (next_pc != branch->predicted_pc)
+    {
+        cpu->counters.mispredicts++;
+    }
+    return next_pc;
+}
+
+/* Resolves the control instruction in the execute latch and recovers if
+ * fetch continued from the wrong pc */
+static void
+resolve_branch(APEX_CPU *cpu, const APEX_OpInfo *op)
+{
+    int next_pc = APEX_resolve_branch(cpu, &cpu->execute, op, APEX_branch_taken(cpu, op));
+
+    if (next_pc != cpu->execute.predicted_pc)
+    {
+        redirect_fetch(cpu, next_pc);
+    }
+}
+
+/* Returns TRUE if an operation that sets the condition flags produces its
+ * result in cycle or later */
+static int
+flags_pending(const APEX_CPU *cpu, int cycle)
+{
+    int i;
+
+    for (i = 0; i < cpu->fu_queue_count; ++i)
+    {
+        if (apex_op_table[cpu->fu_queue[i].insn->opcode].flags &&
+            cpu->fu_queue[i].complete_cycle >= cycle)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Returns TRUE and sets value if stage has computed its write of reg. A
+ * loaded value is only available once the access has completed. */
+int
+APEX_stage_result(const CPU_Stage *stage, int reg, int loaded, int *value)
+{
+    const APEX_Instruction *ins = stage->insn;
+    const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+
+    /* The last write in writeback order wins */
+    if ((op->dst & DST_RS2_POST) && ins->rs2 == reg)
+    {
+        *value = stage->rs2_value + 4;
+        return TRUE;
+    }
+    if ((op->dst & DST_RS1_POST) && ins->rs1 == reg)
+    {
+        *value = stage->rs1_value + 4;
+        return TRUE;
+    }
+    if (op->mem == MEM_LOAD && !loaded)
+    {
+        return FALSE;
+    }
+    *value = stage->result_buffer;
+    return TRUE;
+}
+
+/* Finds the value of reg written by the in-flight instruction seq. Returns
+ * the BYPASS_* path it is taken from, or BYPASS_STALL while it has not been
+ * computed. */
+static int
+bypass_value(const APEX_CPU *cpu, int reg, long seq, int *value)
+{
+    int i;
+
+    if (cpu->memory.has_insn && cpu->memory.seq == seq)
+    {
+        return APEX_stage_result(&cpu->memory, reg, FALSE, value) ? BYPASS_EX_MEM : BYPASS_STALL;
+    }
+    if (cpu->writeback.has_insn && cpu->writeback.seq == seq)
+    {
+        return APEX_stage_result(&cpu->writeback, reg, TRUE, value) ? BYPASS_MEM_WB : BYPASS_STALL;
+    }
+    for (i = 0; i < cpu->fu_queue_count; ++i)
+    {
+        if (cpu->fu_queue[i].seq == seq)
+        {
+            /* A finished operation forwards from its unit while it waits
+             * behind an older one */
+            return cpu->fu_queue[i].complete_cycle <= cpu->clock &&
+                           APEX_stage_result(&cpu->fu_queue[i], reg, FALSE, value)
+                       ? BYPASS_EX_MEM
+                       : BYPASS_STALL;
+        }
+    }
+
+    /* Still waiting in the execute latch */
+    return BYPASS_STALL;
+}
+
+/* Reads a source register in decode and returns the BYPASS_* path the value
+ * came from, or BYPASS_STALL. With forwarding, the value of the youngest
+ * older writer is bypassed as soon as it is computed. Without forwarding,
+ * decode waits until that writer has written back. */
+static int
+read_source_register(const APEX_CPU *cpu, int reg, int *value)
+{
+    long producer = cpu->reg_producer[reg];
+
+    if (producer == 0)
+    {
+        *value = cpu->regs[reg];
+        return BYPASS_REGISTER_FILE;
+    }
+    if (!cpu->config.forwarding)
+    {
+        return BYPASS_STALL;
+    }
+    return bypass_value(cpu, reg, producer, value);
+}
+
 /*
  * Decode Stage of APEX Pipeline
  *
@@ -222,976 +494,1089 @@ APEX_decode(APEX_CPU *cpu)
 {
     if (cpu->decode.has_insn)
     {
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
+        const APEX_Instruction *ins = cpu->decode.insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+        int ready = TRUE;
+
+        /* Read operands from register file based on the instruction type,
+         * operand hazards are re-evaluated every cycle */
+        if (op->src & SRC_RS1)
+        {
+            cpu->decode.rs1_path = read_source_register(cpu, ins->rs1, &cpu->decode.rs1_value);
+            if (cpu->decode.rs1_path == BYPASS_STALL)
+            {
+                if (op->mem == MEM_STORE && cpu->config.forwarding)
+                {
+                    /* Store data is not needed before the Memory stage */
+                    cpu->decode.rs1_path = BYPASS_STORE_DATA;
+                }
+                else
+                {
+                    ready = FALSE;
+                }
+            }
+        }
+        if (op->src & SRC_RS2)
         {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_OR:
-        case OPCODE_AND:
-        case OPCODE_XOR:
-        case OPCODE_CMP:
-        case OPCODE_STORE:
-        case OPCODE_STOREP:
+            cpu->decode.rs2_path = read_source_register(cpu, ins->rs2, &cpu->decode.rs2_value);
+            if (cpu->decode.rs2_path == BYPASS_STALL)
+            {
+                ready = FALSE;
+            }
+        }
+
+        /* A branch resolved here needs the flags of every older operation */
+        if (cpu->config.branch_stage == BRANCH_STAGE_DECODE && op->cond_flags &&
+            flags_pending(cpu, cpu->clock + 1))
         {
-            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+            ready = FALSE;
+        }
 
-            if (cpu->fwd_values[0][cpu->decode.rs1] == 1)
+        /* Execute still holds its instruction when memory is busy */
+        if (ready && !cpu->execute.has_insn)
+        {
+            if (op->src & SRC_RS1)
             {
-                cpu->decode.rs1_value = cpu->fwd_values[1][cpu->decode.rs1];
+                cpu->counters.bypass[cpu->decode.rs1_path]++;
             }
-            if (cpu->fwd_values[0][cpu->decode.rs2] == 1)
+            if (op->src & SRC_RS2)
             {
-                cpu->decode.rs2_value = cpu->fwd_values[1][cpu->decode.rs2];
+                cpu->counters.bypass[cpu->decode.rs2_path]++;
             }
 
-            if (cpu->flag[cpu->decode.rs1] == 1 || cpu->flag[cpu->decode.rs2] == 1)
+            /* Younger readers of its destinations now depend on it */
+            if (op->dst & DST_RD)
             {
-                cpu->stall_flag = 1;
+                cpu->reg_producer[ins->rd] = cpu->decode.seq;
             }
-            break;
-        }
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_JALR:
-        case OPCODE_JUMP:
-        case OPCODE_LOAD:
-        case OPCODE_LOADP:
-        case OPCODE_CML:
-        {
-
-            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-            if (cpu->fwd_values[0][cpu->decode.rs1] == 1)
+            if (op->dst & DST_RS1_POST)
             {
-                cpu->decode.rs1_value = cpu->fwd_values[1][cpu->decode.rs1];
+                cpu->reg_producer[ins->rs1] = cpu->decode.seq;
             }
-            if (cpu->flag[cpu->decode.rs1] == 1)
+            if (op->dst & DST_RS2_POST)
             {
-                cpu->stall_flag = 1;
+                cpu->reg_producer[ins->rs2] = cpu->decode.seq;
             }
-            break;
-        }
-        }
-        if (cpu->stall_flag == 0)
-        {
+
             /* Copy data from decode latch to execute latch*/
             cpu->execute = cpu->decode;
             cpu->decode.has_insn = FALSE;
-        }
+            cpu->counters.issued[1]++;
+            APEX_OBSERVE(cpu, APEX_EVENT_ISSUE, STAGE_DECODE, &cpu->execute, 0, 0, 0);
 
-        if (ENABLE_DEBUG_MESSAGES)
+            /* Resolve branches early, the flags of the older instruction
+             * were set by execute earlier in this cycle */
+            if (cpu->config.branch_stage == BRANCH_STAGE_DECODE && op->ctrl != CTRL_NONE)
+            {
+                resolve_branch(cpu, op);
+            }
+        }
+        else if (!ready)
+        {
+            APEX_count_stall(cpu, cpu->config.forwarding ? STALL_LOAD_USE : STALL_RAW, STAGE_DECODE, &cpu->decode);
+        }
+        else
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            APEX_count_stall(cpu, STALL_EXECUTE_BUSY, STAGE_DECODE, &cpu->decode);
         }
+
+        APEX_stage_event(cpu, STAGE_DECODE, &cpu->decode);
+    }
+}
+
+/* Moves the oldest operation on to the Memory stage once it is done */
+static void
+complete_operation(APEX_CPU *cpu)
+{
+    if (cpu->fu_queue[0].complete_cycle > cpu->clock)
+    {
+        return;
+    }
+    if (cpu->memory.has_insn)
+    {
+        APEX_count_stall(cpu, STALL_MEMORY_BUSY, STAGE_EXECUTE, &cpu->fu_queue[0]);
+        return;
     }
+
+    /* Copy data from the functional unit to memory latch*/
+    cpu->memory = cpu->fu_queue[0];
+    cpu->fu_queue_count--;
+    memmove(&cpu->fu_queue[0], &cpu->fu_queue[1], cpu->fu_queue_count * sizeof(CPU_Stage));
+    cpu->fu_queue[cpu->fu_queue_count].has_insn = FALSE;
 }
 
 /*
  * Execute Stage of APEX Pipeline
  *
+ * Instructions start on their functional unit in order and finish after the
+ * unit latency. Results move on to the Memory stage in program order, so a
+ * short operation waits behind an older long one.
+ *
  * Note: You are free to edit this function according to your implementation
  */
 static void
 APEX_execute(APEX_CPU *cpu)
 {
+    int busy = 0;
+    int i;
+
+    /* Operations started in earlier cycles */
+    for (i = 0; i < cpu->fu_queue_count; ++i)
+    {
+        if (cpu->fu_queue[i].complete_cycle >= cpu->clock)
+        {
+            busy |= 1 << apex_op_table[cpu->fu_queue[i].insn->opcode].unit;
+        }
+        APEX_stage_event(cpu, STAGE_EXECUTE, &cpu->fu_queue[i]);
+    }
+
     if (cpu->execute.has_insn)
     {
+        const APEX_Instruction *ins = cpu->execute.insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+        const APEX_FUConfig *unit = &cpu->config.fu[op->unit];
 
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
+        if (cpu->memory.has_insn)
         {
-        case OPCODE_MOVC:
+            /* Memory stage is still busy with an older access */
+            APEX_count_stall(cpu, STALL_MEMORY_BUSY, STAGE_EXECUTE, &cpu->execute);
+        }
+        else if (cpu->fu_queue_count == MAX_FU_IN_FLIGHT || cpu->fu_free_cycle[op->unit] > cpu->clock ||
+                 (op->cond_flags && cpu->fu_queue_count && flags_pending(cpu, cpu->clock)))
         {
-            cpu->execute.result_buffer = cpu->execute.imm;
-
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            break;
+            /* The unit is still working on an older operation, or a branch
+             * waits for the flags of one */
+            APEX_count_stall(cpu, STALL_FU_BUSY, STAGE_EXECUTE, &cpu->execute);
         }
-        case OPCODE_ADD:
+        else
         {
-            cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.rs2_value;
-
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
+            /* Execute logic based on instruction type */
+            if (op->exec)
             {
-                cpu->zero_flag = FALSE;
+                op->exec(&cpu->execute);
             }
-            if (cpu->execute.result_buffer > 0)
+            if (op->flags)
             {
-                cpu->positive_flag = TRUE;
+                APEX_update_flags(cpu, op->flags, cpu->execute.result_buffer);
             }
-            else
+            if (op->ctrl != CTRL_NONE && cpu->config.branch_stage == BRANCH_STAGE_EXECUTE)
             {
-                cpu->positive_flag = FALSE;
+                resolve_branch(cpu, op);
             }
-            if (cpu->execute.result_buffer < 0)
+
+            cpu->execute.complete_cycle = cpu->clock + unit->latency - 1;
+            cpu->fu_free_cycle[op->unit] = cpu->clock + (unit->pipelined ? 1 : unit->latency);
+            cpu->counters.fu_issued[op->unit]++;
+            busy |= 1 << op->unit;
+
+            if (unit->latency == 1 && cpu->fu_queue_count == 0)
             {
-                cpu->negative_flag = TRUE;
+                /* Nothing older in flight, a single-cycle operation goes
+                 * straight to the memory latch */
+                cpu->memory = cpu->execute;
             }
             else
             {
-                cpu->negative_flag = FALSE;
+                cpu->fu_queue[cpu->fu_queue_count++] = cpu->execute;
             }
-            break;
+            cpu->execute.has_insn = FALSE;
         }
-        case OPCODE_ADDL:
-        {
-            cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
 
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
+        APEX_stage_event(cpu, STAGE_EXECUTE, &cpu->execute);
+    }
+
+    for (i = 0; busy; ++i, busy >>= 1)
+    {
+        cpu->counters.fu_busy[i] += busy & 1;
+    }
+
+    if (cpu->fu_queue_count > 0)
+    {
+        complete_operation(cpu);
+    }
+}
+
+/* Returns the cycles a data memory access to address takes, from the data
+ * cache when one is configured */
+int
+APEX_data_access_latency(APEX_CPU *cpu, int address, int is_write)
+{
+    if (cpu->config.dcache.size == 0)
+    {
+        return cpu->config.memory_latency;
+    }
+    if (!cpu->dcache.lines && APEX_cache_init(&cpu->dcache, &cpu->config.dcache) != 0)
+    {
+        cpu->config.dcache.size = 0;
+        return cpu->config.memory_latency;
+    }
+    return APEX_cache_access(&cpu->dcache, (unsigned int)address, is_write);
+}
+
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_memory(APEX_CPU *cpu)
+{
+    if (cpu->memory.has_insn)
+    {
+        const APEX_Instruction *ins = cpu->memory.insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+
+        /* Data memory accesses occupy the stage for memory_latency cycles */
+        if (op->mem != MEM_NONE)
+        {
+            if (cpu->memory_cycles_left == 0)
             {
-                cpu->negative_flag = TRUE;
+                cpu->memory_cycles_left = APEX_data_access_latency(cpu, cpu->memory.memory_address,
+                                                                   op->mem == MEM_STORE);
             }
-            else
+            if (--cpu->memory_cycles_left > 0)
             {
-                cpu->negative_flag = FALSE;
+                APEX_count_stall(cpu, STALL_MEMORY_LATENCY, STAGE_MEMORY, &cpu->memory);
+                APEX_stage_event(cpu, STAGE_MEMORY, &cpu->memory);
+                return;
             }
-            break;
         }
-        case OPCODE_SUB:
+
+        if (op->mem != MEM_NONE && !APEX_mem_in_range(cpu, cpu->memory.memory_address))
         {
-            cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
+            /* Stop the pipeline with the faulting instruction in Memory */
+            cpu->mem_fault = TRUE;
+            cpu->mem_fault_pc = cpu->memory.pc;
+            cpu->mem_fault_address = cpu->memory.memory_address;
+            return;
+        }
 
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
-        }
-        case OPCODE_SUBL:
+        if (op->mem == MEM_LOAD)
         {
-            cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
-
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
+            /* Read from data memory */
+            APEX_mem_read(cpu, cpu->memory.memory_address, &cpu->memory.result_buffer);
+            APEX_OBSERVE(cpu, APEX_EVENT_MEM_ACCESS, STAGE_MEMORY, &cpu->memory, FALSE,
+                         cpu->memory.memory_address, cpu->memory.result_buffer);
         }
-        case OPCODE_MUL:
+        else if (op->mem == MEM_STORE)
         {
-            cpu->execute.result_buffer = cpu->execute.rs1_value * cpu->execute.rs2_value;
-
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
+            if (cpu->memory.rs1_path == BYPASS_STORE_DATA)
             {
-                cpu->negative_flag = TRUE;
+                /* The producer of the data retired before the store got
+                 * here, ahead of every younger writer */
+                cpu->memory.rs1_value = cpu->regs[ins->rs1];
             }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
-        }
-        case OPCODE_OR:
-        {
-            cpu->execute.result_buffer = cpu->execute.rs1_value | cpu->execute.rs2_value;
 
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
+            /* Write to data memory */
+            APEX_mem_write(cpu, cpu->memory.memory_address, cpu->memory.rs1_value);
+            APEX_OBSERVE(cpu, APEX_EVENT_MEM_ACCESS, STAGE_MEMORY, &cpu->memory, TRUE,
+                         cpu->memory.memory_address, cpu->memory.rs1_value);
         }
-        case OPCODE_AND:
-        {
-            cpu->execute.result_buffer = cpu->execute.rs1_value & cpu->execute.rs2_value;
 
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
-        }
-        case OPCODE_XOR:
-        {
-            cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
+        /* Copy data from memory latch to writeback latch*/
+        cpu->writeback = cpu->memory;
+        cpu->memory.has_insn = FALSE;
 
-            /* Set the zero flag based on the result buffer */
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
-        }
+        APEX_stage_event(cpu, STAGE_MEMORY, &cpu->memory);
+    }
+}
 
-        case OPCODE_LOAD:
-        {
-            cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-            cpu->flag[cpu->execute.rd] = 1;
-            break;
-        }
-        case OPCODE_STORE:
+/* Writes a register in writeback, the register file is up to date once
+ * its youngest in-flight writer has written it */
+static void
+write_register(APEX_CPU *cpu, int reg, int value)
+{
+    cpu->regs[reg] = value;
+    if (cpu->reg_producer[reg] == cpu->writeback.seq)
+    {
+        cpu->reg_producer[reg] = 0;
+    }
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu)
+{
+    if (cpu->writeback.has_insn)
+    {
+        const APEX_Instruction *ins = cpu->writeback.insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+
+        /* Write result to register file based on instruction type */
+        if (op->dst & DST_RD)
         {
-            cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-            break;
+            write_register(cpu, ins->rd, cpu->writeback.result_buffer);
         }
-        case OPCODE_LOADP:
+        if (op->dst & DST_RS1_POST)
         {
-            cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-            cpu->flag[cpu->execute.rd] = 1;
-            break;
+            write_register(cpu, ins->rs1, cpu->writeback.rs1_value + 4);
         }
-        case OPCODE_STOREP:
+        if (op->dst & DST_RS2_POST)
         {
-            cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-            break;
+            write_register(cpu, ins->rs2, cpu->writeback.rs2_value + 4);
         }
 
-        case OPCODE_CML:
+        cpu->insn_completed++;
+        cpu->counters.retired++;
+        cpu->counters.retired_by_opcode[ins->opcode]++;
+        if (cpu->profile)
         {
-            cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
+            APEX_profile_entry(cpu, cpu->writeback.pc)->executions++;
         }
-        case OPCODE_CMP:
+        APEX_OBSERVE(cpu, APEX_EVENT_RETIRE, STAGE_WRITEBACK, &cpu->writeback, 0, 0, 0);
+        cpu->writeback.has_insn = FALSE;
+
+        APEX_stage_event(cpu, STAGE_WRITEBACK, &cpu->writeback);
+
+        if (ins->opcode == OPCODE_HALT)
         {
-            cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
-            if (cpu->execute.result_buffer == 0)
-            {
-                cpu->zero_flag = TRUE;
-            }
-            else
-            {
-                cpu->zero_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer > 0)
-            {
-                cpu->positive_flag = TRUE;
-            }
-            else
-            {
-                cpu->positive_flag = FALSE;
-            }
-            if (cpu->execute.result_buffer < 0)
-            {
-                cpu->negative_flag = TRUE;
-            }
-            else
-            {
-                cpu->negative_flag = FALSE;
-            }
-            break;
+            /* Stop the APEX simulator */
+            return TRUE;
         }
+    }
 
-        case OPCODE_BZ:
-        {
-            if (cpu->zero_flag == TRUE)
-            {
-                /* Calculate new PC, and send it to fetch unit */
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    /* Default */
+    return 0;
+}
 
-                /* Since we are using reverse callbacks for pipeline stages,
-                 * this will prevent the new instruction from being fetched in the current cycle*/
-                cpu->fetch_from_next_cycle = TRUE;
+/* Fills config with the default microarchitecture, which matches the
+ * original single-cycle memory and functional units, forwarding,
+ * execute-resolved branches */
+void
+APEX_config_default(APEX_Config *config)
+{
+    int i;
 
-                /* Flush previous stages */
-                cpu->decode.has_insn = FALSE;
+    config->memory_latency = 1;
+    config->forwarding = TRUE;
+    config->branch_stage = BRANCH_STAGE_EXECUTE;
+    config->memory_size = DATA_MEMORY_SIZE;
+    config->predictor = PREDICTOR_NONE;
+    config->btb_entries = 64;
+    config->bp_entries = 256;
+    config->history_bits = 8;
+    APEX_cache_config_default(&config->dcache);
+    APEX_cache_config_default(&config->icache);
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        config->fu[i].latency = 1;
+        config->fu[i].pipelined = i != FU_DIV;
+    }
+    config->width = 1;
+    config->rf_read_ports = 0;
+    config->core = CORE_INORDER;
+    config->rob_size = 32;
+    config->iq_size = 16;
+    config->lsq_size = 8;
+    config->phys_regs = 64;
+    config->cycle_skip = TRUE;
+}
 
-                /* Make sure fetch stage is enabled to start fetching from new PC */
-                cpu->fetch.has_insn = TRUE;
-            }
-            break;
-        }
+/* Returns TRUE if value is a power of two no larger than max */
+static int
+is_table_size(int value, int max)
+{
+    return value >= 1 && value <= max && (value & (value - 1)) == 0;
+}
 
-        case OPCODE_BNZ:
-        {
-            if (cpu->zero_flag == FALSE)
-            {
-                /* Calculate new PC, and send it to fetch unit */
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
+/* Sets the latency or pipelined parameter of one functional unit */
+static int
+fu_config_set(APEX_FUConfig *unit, const char *name, const char *value)
+{
+    if (strcmp(name, "latency") == 0)
+    {
+        unit->latency = atoi(value);
+        return unit->latency >= 1 ? 0 : -1;
+    }
+    if (strcmp(name, "pipelined") == 0)
+    {
+        unit->pipelined = atoi(value) != 0;
+        return 0;
+    }
+    return -1;
+}
 
-                /* Since we are using reverse callbacks for pipeline stages,
-                 * this will prevent the new instruction from being fetched in the current cycle*/
-                cpu->fetch_from_next_cycle = TRUE;
+/* Returns TRUE if every cache parameter is one APEX_cache_config_set
+ * accepts */
+static int
+cache_config_in_range(const APEX_CacheConfig *cache)
+{
+    return cache->size >= 0 && (cache->size & (cache->size - 1)) == 0 &&
+           cache->assoc >= 1 && (cache->assoc & (cache->assoc - 1)) == 0 &&
+           cache->line_size >= 1 && (cache->line_size & (cache->line_size - 1)) == 0 &&
+           (cache->replacement == CACHE_LRU || cache->replacement == CACHE_RANDOM) &&
+           cache->hit_latency >= 1 && cache->miss_latency >= 1;
+}
 
-                /* Flush previous stages */
-                cpu->decode.has_insn = FALSE;
+/*
+ * Checks a configuration that was not built by APEX_config_set, such as
+ * one read back from a checkpoint.
+ *
+ * Returns TRUE if every parameter is a value APEX_config_set accepts.
+ */
+int
+APEX_config_valid(const APEX_Config *config)
+{
+    int i;
 
-                /* Make sure fetch stage is enabled to start fetching from new PC */
-                cpu->fetch.has_insn = TRUE;
-            }
-            break;
-        }
-        case OPCODE_BP:
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        if (config->fu[i].latency < 1)
         {
-            if (cpu->positive_flag == TRUE)
-            {
+            return FALSE;
+        }
+    }
+    return config->memory_latency >= 1 &&
+           (config->branch_stage == BRANCH_STAGE_EXECUTE ||
+            config->branch_stage == BRANCH_STAGE_DECODE) &&
+           config->memory_size >= 1 && config->memory_size <= MAX_DATA_MEMORY_SIZE &&
+           config->predictor >= PREDICTOR_NONE && config->predictor <= PREDICTOR_GSHARE &&
+           is_table_size(config->btb_entries, MAX_BTB_ENTRIES) &&
+           is_table_size(config->bp_entries, MAX_BP_ENTRIES) &&
+           config->history_bits >= 0 && config->history_bits <= 12 &&
+           cache_config_in_range(&config->dcache) && cache_config_in_range(&config->icache) &&
+           config->width >= 1 && config->width <= MAX_WIDTH && config->rf_read_ports >= 0 &&
+           (config->core == CORE_INORDER || config->core == CORE_OOO) &&
+           config->rob_size >= 1 && config->rob_size <= MAX_ROB_SIZE &&
+           config->iq_size >= 1 && config->iq_size <= MAX_IQ_SIZE &&
+           config->lsq_size >= 1 && config->lsq_size <= MAX_LSQ_SIZE &&
+           config->phys_regs >= REG_FILE_SIZE + 3 && config->phys_regs <= MAX_PHYS_REGS;
+}
+
+/*
+ * Sets one configuration parameter from its textual value, as given on the
+ * command line or in a sweep grid.
+ *
+ * Returns 0 on success, -1 for an unknown parameter or invalid value.
+ */
+int
+APEX_config_set(APEX_Config *config, const char *name, const char *value)
+{
+    int i;
 
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    if (strcmp(name, "memory_latency") == 0)
+    {
+        config->memory_latency = atoi(value);
+        return config->memory_latency >= 1 ? 0 : -1;
+    }
 
-                cpu->fetch_from_next_cycle = TRUE;
+    if (strcmp(name, "forwarding") == 0)
+    {
+        config->forwarding = atoi(value) != 0;
+        return 0;
+    }
 
-                cpu->decode.has_insn = FALSE;
+    if (strcmp(name, "cycle_skip") == 0)
+    {
+        config->cycle_skip = atoi(value) != 0;
+        return 0;
+    }
 
-                cpu->fetch.has_insn = TRUE;
-            }
-            break;
+    if (strcmp(name, "branch_stage") == 0)
+    {
+        if (strcmp(value, "execute") == 0)
+        {
+            config->branch_stage = BRANCH_STAGE_EXECUTE;
+            return 0;
+        }
+        if (strcmp(value, "decode") == 0)
+        {
+            config->branch_stage = BRANCH_STAGE_DECODE;
+            return 0;
         }
+        return -1;
+    }
+
+    if (strcmp(name, "predictor") == 0)
+    {
+        static const char *const predictors[] = {"none", "static", "bimodal", "gshare"};
 
-        case OPCODE_BNP:
+        for (i = 0; i < 4; ++i)
         {
-            if (cpu->positive_flag == FALSE)
+            if (strcmp(value, predictors[i]) == 0)
             {
+                config->predictor = i;
+                return 0;
+            }
+        }
+        return -1;
+    }
 
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                cpu->fetch_from_next_cycle = TRUE;
+    if (strcmp(name, "btb_entries") == 0)
+    {
+        config->btb_entries = atoi(value);
+        return is_table_size(config->btb_entries, MAX_BTB_ENTRIES) ? 0 : -1;
+    }
 
-                cpu->decode.has_insn = FALSE;
+    if (strcmp(name, "bp_entries") == 0)
+    {
+        config->bp_entries = atoi(value);
+        return is_table_size(config->bp_entries, MAX_BP_ENTRIES) ? 0 : -1;
+    }
 
-                cpu->fetch.has_insn = TRUE;
-            }
-            break;
-        }
-        case OPCODE_BN:
-        {
-            if (cpu->negative_flag == TRUE)
-            {
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    if (strcmp(name, "history_bits") == 0)
+    {
+        config->history_bits = atoi(value);
+        return config->history_bits >= 0 && config->history_bits <= 12 ? 0 : -1;
+    }
 
-                cpu->fetch_from_next_cycle = TRUE;
+    if (strncmp(name, "dcache_", 7) == 0)
+    {
+        return APEX_cache_config_set(&config->dcache, name + 7, value);
+    }
 
-                cpu->decode.has_insn = FALSE;
+    if (strncmp(name, "icache_", 7) == 0)
+    {
+        return APEX_cache_config_set(&config->icache, name + 7, value);
+    }
 
-                cpu->fetch.has_insn = TRUE;
-            }
-            break;
-        }
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        size_t len = strlen(apex_fu_names[i]);
 
-        case OPCODE_BNN:
+        if (strncmp(name, apex_fu_names[i], len) == 0 && name[len] == '_')
         {
-            if (cpu->negative_flag == FALSE)
-            {
-                cpu->pc = cpu->execute.pc + cpu->execute.imm;
+            return fu_config_set(&config->fu[i], name + len + 1, value);
+        }
+    }
 
-                cpu->fetch_from_next_cycle = TRUE;
+    if (strcmp(name, "width") == 0)
+    {
+        config->width = atoi(value);
+        return config->width >= 1 && config->width <= MAX_WIDTH ? 0 : -1;
+    }
 
-                cpu->decode.has_insn = FALSE;
+    if (strcmp(name, "rf_read_ports") == 0)
+    {
+        config->rf_read_ports = atoi(value);
+        return config->rf_read_ports >= 0 ? 0 : -1;
+    }
 
-                cpu->fetch.has_insn = TRUE;
-            }
-            break;
+    if (strcmp(name, "core") == 0)
+    {
+        if (strcmp(value, "inorder") == 0)
+        {
+            config->core = CORE_INORDER;
+            return 0;
         }
-        case OPCODE_JALR:
+        if (strcmp(value, "ooo") == 0)
         {
-            cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
+            config->core = CORE_OOO;
+            return 0;
+        }
+        return -1;
+    }
 
-            cpu->fetch_from_next_cycle = TRUE;
+    if (strcmp(name, "rob_size") == 0)
+    {
+        config->rob_size = atoi(value);
+        return config->rob_size >= 1 && config->rob_size <= MAX_ROB_SIZE ? 0 : -1;
+    }
+
+    if (strcmp(name, "iq_size") == 0)
+    {
+        config->iq_size = atoi(value);
+        return config->iq_size >= 1 && config->iq_size <= MAX_IQ_SIZE ? 0 : -1;
+    }
+
+    if (strcmp(name, "lsq_size") == 0)
+    {
+        config->lsq_size = atoi(value);
+        return config->lsq_size >= 1 && config->lsq_size <= MAX_LSQ_SIZE ? 0 : -1;
+    }
+
+    if (strcmp(name, "phys_regs") == 0)
+    {
+        /* Every architectural register and the flags, and two to rename */
+        config->phys_regs = atoi(value);
+        return config->phys_regs >= REG_FILE_SIZE + 3 && config->phys_regs <= MAX_PHYS_REGS ? 0 : -1;
+    }
+
+    if (strcmp(name, "memory_size") == 0)
+    {
+        config->memory_size = atol(value);
+        return config->memory_size >= 1 && config->memory_size <= MAX_DATA_MEMORY_SIZE ? 0 : -1;
+    }
+
+    return -1;
+}
+
+/* Allocates a cpu in its reset state, without code memory */
+APEX_CPU *
+APEX_cpu_alloc(void)
+{
+    APEX_CPU *cpu = calloc(1, sizeof(APEX_CPU));
 
-            cpu->decode.has_insn = FALSE;
+    if (!cpu)
+    {
+        return NULL;
+    }
 
-            cpu->fetch.has_insn = TRUE;
-            cpu->execute.result_buffer = cpu->execute.pc + 4;
-            break;
-        }
-        case OPCODE_JUMP:
-        {
-            cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+    cpu->single_step = ENABLE_SINGLE_STEP;
+    cpu->debug_messages = ENABLE_DEBUG_MESSAGES;
+    cpu->out = stdout;
+    cpu->diag = stderr;
+    APEX_config_default(&cpu->config);
+    APEX_bp_reset(cpu);
 
-            cpu->fetch_from_next_cycle = TRUE;
+    /* To start fetch stage */
+    cpu->fetch.has_insn = TRUE;
+    return cpu;
+}
 
-            cpu->decode.has_insn = FALSE;
+/*
+ * Creates a cpu over an already decoded code memory. The code memory is
+ * only read, so it may be shared by many cpus, and is not freed by
+ * APEX_cpu_stop.
+ */
+APEX_CPU *
+APEX_cpu_init_shared(APEX_Instruction *code_memory, int code_memory_size)
+{
+    APEX_CPU *cpu = APEX_cpu_alloc();
 
-            cpu->fetch.has_insn = TRUE;
-            break;
-        }
-        }
-        switch (cpu->execute.opcode)
-        {
-        case OPCODE_ADD:
-        case OPCODE_ADDL:
-        case OPCODE_SUB:
-        case OPCODE_SUBL:
-        case OPCODE_MUL:
-        case OPCODE_OR:
-        case OPCODE_AND:
-        case OPCODE_XOR:
-        case OPCODE_MOVC:
-        {
-            cpu->fwd_values[0][cpu->execute.rd] = 1;
-            cpu->fwd_values[1][cpu->execute.rd] = cpu->execute.result_buffer;
-            break;
-        }
-        case OPCODE_STOREP:
-        {
-            cpu->fwd_values[0][cpu->execute.rs2] = 1;
-            cpu->fwd_values[1][cpu->execute.rs2] = cpu->execute.rs2_value + 4;
-            break;
-        }
-        case OPCODE_LOADP:
-        {
-            cpu->fwd_values[0][cpu->execute.rs1] = 1;
-            cpu->fwd_values[1][cpu->execute.rs1] = cpu->execute.rs1_value + 4;
-            break;
-        }
-        }
+    if (!cpu)
+    {
+        return NULL;
+    }
 
-        /* Copy data from execute latch to memory latch*/
-        cpu->memory = cpu->execute;
-        cpu->execute.has_insn = FALSE;
+    cpu->code_memory = code_memory;
+    cpu->code_memory_size = code_memory_size;
+    cpu->code_memory_shared = TRUE;
+    return cpu;
+}
 
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("Execute", &cpu->execute);
-        }
+/*
+ * Starts charging cycles, stalls, executions and flushes to the
+ * instruction responsible, see APEX_cpu_print_profile.
+ *
+ * Returns 0 on success, -1 if the profile cannot be allocated.
+ */
+int
+APEX_cpu_enable_profile(APEX_CPU *cpu)
+{
+    if (!cpu->profile)
+    {
+        cpu->profile = calloc(cpu->code_memory_size, sizeof(APEX_PcProfile));
     }
+    return cpu->profile ? 0 : -1;
 }
 
 /*
- * Memory Stage of APEX Pipeline
+ * Calls fn with every APEX_EVENT_* in events from the next one on.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns a handle for APEX_cpu_unobserve, or -1 if MAX_OBSERVERS are
+ * registered or the hooks are compiled out.
  */
-static void
-APEX_memory(APEX_CPU *cpu)
+int
+APEX_cpu_observe(APEX_CPU *cpu, unsigned int events, apex_observer fn, void *arg)
 {
-    if (cpu->memory.has_insn)
+    int i;
+
+    if (!ENABLE_OBSERVERS || !fn || !(events & APEX_EVENT_ALL))
     {
-        switch (cpu->memory.opcode)
-        {
-        case OPCODE_LOAD:
-        {
-            /* Read from data memory */
-            cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-            break;
-        }
-        case OPCODE_STORE:
-        {
-            /* Read from data memory */
-            cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-            break;
-        }
-        case OPCODE_LOADP:
-        {
-            /* Read from data memory */
-            cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-            break;
-        }
-        case OPCODE_STOREP:
-        {
-            /* Read from data memory */
-            cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-            break;
-        }
-        }
-        switch (cpu->memory.opcode)
-        {
-        case OPCODE_LOAD:
-        case OPCODE_LOADP:
+        return -1;
+    }
+    for (i = 0; i < MAX_OBSERVERS; ++i)
+    {
+        if (!cpu->observers[i].events)
         {
-            cpu->fwd_values[0][cpu->memory.rd] = 1;
-            cpu->fwd_values[1][cpu->memory.rd] = cpu->memory.result_buffer;
-            cpu->stall_flag = 0;
-            cpu->flag[cpu->memory.rd] = 0;
-            break;
+            cpu->observers[i].events = events & APEX_EVENT_ALL;
+            cpu->observers[i].fn = fn;
+            cpu->observers[i].arg = arg;
+            cpu->observed_events |= cpu->observers[i].events;
+            return i;
         }
-        }
-        /* Copy data from memory latch to writeback latch*/
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
+    }
+    return -1;
+}
 
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("Memory", &cpu->memory);
-        }
+void
+APEX_cpu_unobserve(APEX_CPU *cpu, int handle)
+{
+    int i;
+
+    if (handle < 0 || handle >= MAX_OBSERVERS)
+    {
+        return;
+    }
+    cpu->observers[handle].events = 0;
+    cpu->observed_events = 0;
+    for (i = 0; i < MAX_OBSERVERS; ++i)
+    {
+        cpu->observed_events |= cpu->observers[i].events;
     }
 }
 
 /*
- * Writeback Stage of APEX Pipeline
+ * Simulates one clock cycle of the scalar pipeline. Stages are called in
+ * reverse order so that each stage consumes its latch before the previous
+ * stage refills it.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns TRUE once HALT has retired or on a data memory or fetch fault.
  */
 static int
-APEX_writeback(APEX_CPU *cpu)
+pipeline_cycle(APEX_CPU *cpu)
 {
-    if (cpu->writeback.has_insn)
+    /* Occupancy is sampled as the cycle starts */
+    cpu->counters.occupancy[STAGE_FETCH] += cpu->fetch.has_insn;
+    cpu->counters.occupancy[STAGE_DECODE] += cpu->decode.has_insn;
+    cpu->counters.occupancy[STAGE_EXECUTE] += cpu->execute.has_insn || cpu->fu_queue_count;
+    cpu->counters.occupancy[STAGE_MEMORY] += cpu->memory.has_insn;
+    cpu->counters.occupancy[STAGE_WRITEBACK] += cpu->writeback.has_insn;
+    if (cpu->profile)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
-        {
-        case OPCODE_ADD:
-        case OPCODE_ADDL:
-        case OPCODE_SUB:
-        case OPCODE_SUBL:
-        case OPCODE_MUL:
-        case OPCODE_OR:
-        case OPCODE_AND:
-        case OPCODE_XOR:
-        case OPCODE_LOAD:
-        case OPCODE_MOVC:
-        case OPCODE_JALR:
-        {
-            cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-            if ((cpu->writeback.rd == cpu->memory.rd && cpu->memory.has_insn == TRUE) || (cpu->writeback.rd == cpu->execute.rd && cpu->execute.has_insn == TRUE))
-            {
-                cpu->fwd_values[0][cpu->writeback.rd] = 1;
-            }
-            else
-            {
-                cpu->fwd_values[0][cpu->writeback.rd] = 0;
-            }
-            break;
-        }
-        case OPCODE_LOADP:
-        {
-
-            cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-            cpu->regs[cpu->writeback.rs1] = cpu->writeback.rs1_value + 4;
-
-            if ((cpu->writeback.rd == cpu->memory.rd && cpu->memory.has_insn == TRUE) || (cpu->writeback.rd == cpu->execute.rd && cpu->execute.has_insn == TRUE))
-            {
-                cpu->fwd_values[0][cpu->writeback.rd] = 1;
-            }
-            else
-            {
-                cpu->fwd_values[0][cpu->writeback.rd] = 0;
-            }
-            if ((cpu->writeback.rs1 == cpu->memory.rd && cpu->memory.has_insn == TRUE) || (cpu->writeback.rs1 == cpu->execute.rd && cpu->execute.has_insn == TRUE))
-            {
+        profile_cycle(cpu);
+    }
 
-                cpu->fwd_values[0][cpu->writeback.rs1] = 1;
-            }
-            else
-            {
+    if (APEX_writeback(cpu))
+    {
+        /* Halt in writeback stage */
+        return TRUE;
+    }
 
-                cpu->fwd_values[0][cpu->writeback.rs1] = 0;
-            }
-            break;
-        }
-        case OPCODE_STOREP:
-        {
-            cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-            cpu->regs[cpu->writeback.rs2] = cpu->writeback.rs2_value + 4;
+    APEX_memory(cpu);
+    if (cpu->mem_fault)
+    {
+        /* Halt on a data memory fault */
+        return TRUE;
+    }
+    APEX_execute(cpu);
+    APEX_decode(cpu);
+    APEX_fetch(cpu);
+    return APEX_fetch_faulted(cpu, !cpu->decode.has_insn && !cpu->execute.has_insn &&
+                                       !cpu->memory.has_insn && !cpu->writeback.has_insn &&
+                                       cpu->fu_queue_count == 0);
+}
 
-            if ((cpu->writeback.rd == cpu->memory.rd && cpu->memory.has_insn == TRUE) || (cpu->writeback.rd == cpu->execute.rd && cpu->execute.has_insn == TRUE))
-            {
-                cpu->fwd_values[0][cpu->writeback.rd] = 1;
-            }
-            else
-            {
-                cpu->fwd_values[0][cpu->writeback.rd] = 0;
-            }
-            if ((cpu->writeback.rs2 == cpu->memory.rd && cpu->memory.has_insn == TRUE) || (cpu->writeback.rs2 == cpu->execute.rd && cpu->execute.has_insn == TRUE))
-            {
+/* Words of the state that change whenever an instruction makes progress in
+ * one of the cores, see progress_signature */
+#define PROGRESS_WORDS 24
 
-                cpu->fwd_values[0][cpu->writeback.rs2] = 1;
-            }
-            else
-            {
+/* State as a cycle that may be repeated started, see skip_cycles */
+typedef struct APEX_CycleSnapshot
+{
+    APEX_Counters counters;
+    long progress[PROGRESS_WORDS];
+    int memory_cycles_left;
+    int fetch_cycles_left;
+} APEX_CycleSnapshot;
+
+/* Returns TRUE if a latency started earlier runs past the next cycle, the
+ * only case in which cycles can be skipped */
+static int
+latency_pending(const APEX_CPU *cpu)
+{
+    const APEX_StageGroup *execute = &cpu->wide[STAGE_EXECUTE];
+    int later = cpu->clock + 1;
+    int i;
 
-                cpu->fwd_values[0][cpu->writeback.rs2] = 0;
-            }
-            break;
-        }
+    if (cpu->memory_cycles_left > 1 || cpu->fetch_cycles_left > 1 ||
+        cpu->ooo.mem_port_free_cycle > later)
+    {
+        return TRUE;
+    }
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        if (cpu->fu_free_cycle[i] > later || cpu->ooo.unit_busy_until[i] > later)
+        {
+            return TRUE;
         }
-
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
-
-        if (ENABLE_DEBUG_MESSAGES)
+    }
+    for (i = 0; i < cpu->fu_queue_count; ++i)
+    {
+        if (cpu->fu_queue[i].complete_cycle > later)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            return TRUE;
         }
-
-        if (cpu->writeback.opcode == OPCODE_HALT)
+    }
+    for (i = 0; i < execute->count && execute->executed; ++i)
+    {
+        if (execute->slot[i].complete_cycle > later)
         {
-            /* Stop the APEX simulator */
             return TRUE;
         }
     }
-
-    /* Default */
-    return 0;
+    return FALSE;
 }
 
-/*
- * This function creates and initializes APEX cpu.
- *
- * Note: You are free to edit this function according to your implementation
- */
-APEX_CPU *
-APEX_cpu_init(const char *filename)
+/* Fills words with the instructions each stage of the scalar, superscalar
+ * and out-of-order cores holds and with how far fetch and retirement have
+ * got. A cycle that leaves them as they were only counted down latencies
+ * and counted stalls. An out-of-order load completes through the data
+ * memory port, by forwarding or, with its fault, at once, which the port
+ * and forwarding count and next_event cover. */
+static void
+progress_signature(const APEX_CPU *cpu, long *words)
 {
+    const CPU_Stage *latches[NUM_STAGES] = {&cpu->fetch, &cpu->decode, &cpu->execute,
+                                            &cpu->memory, &cpu->writeback};
+    const APEX_OutOfOrder *ooo = &cpu->ooo;
+    int n = 0;
     int i;
-    APEX_CPU *cpu;
 
-    if (!filename)
+    for (i = 0; i < NUM_STAGES; ++i)
     {
-        return NULL;
+        words[n++] = latches[i]->has_insn ? latches[i]->seq : -1;
+        words[n++] = cpu->wide[i].count;
+    }
+    words[n++] = cpu->wide[STAGE_EXECUTE].executed;
+    words[n++] = cpu->fu_queue_count;
+    words[n++] = ooo->rob_head;
+    words[n++] = ooo->rob_count;
+    words[n++] = ooo->iq_count;
+    words[n++] = ooo->lsq_count;
+    words[n++] = ooo->mem_port_free_cycle;
+    words[n++] = cpu->counters.store_forwards;
+    words[n++] = cpu->pc;
+    words[n++] = cpu->fetch_from_next_cycle;
+    words[n++] = cpu->insn_fetched;
+    words[n++] = cpu->insn_completed;
+    words[n++] = cpu->dcache.accesses;
+    words[n++] = cpu->icache.accesses;
+}
+
+/* Lowers *event to cycle if it is still to come */
+static void
+event_at(const APEX_CPU *cpu, int *event, int cycle)
+{
+    if (cycle > cpu->clock && cycle < *event)
+    {
+        *event = cycle;
     }
+}
 
-    cpu = calloc(1, sizeof(APEX_CPU));
+/* Returns the first cycle after this one in which a latency started
+ * earlier has ended, or INT_MAX if none is running */
+static int
+next_event(const APEX_CPU *cpu)
+{
+    const APEX_StageGroup *execute = &cpu->wide[STAGE_EXECUTE];
+    const APEX_OutOfOrder *ooo = &cpu->ooo;
+    int event = INT_MAX;
+    int i;
 
-    if (!cpu)
+    /* The access in Memory completes, fetch moves on after an I-cache miss */
+    if (cpu->memory_cycles_left > 0)
     {
-        return NULL;
+        event_at(cpu, &event, cpu->clock + cpu->memory_cycles_left);
+    }
+    if (cpu->fetch_cycles_left > 0)
+    {
+        event_at(cpu, &event, cpu->clock + cpu->fetch_cycles_left + 1);
     }
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
+    /* A unit accepts an operation or goes idle, data memory takes an access */
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        event_at(cpu, &event, cpu->fu_free_cycle[i]);
+        event_at(cpu, &event, ooo->unit_busy_until[i] + 1);
+    }
+    event_at(cpu, &event, ooo->mem_port_free_cycle);
 
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    /* An operation can forward its result, and then no longer keeps its
+     * unit busy */
+    for (i = 0; i < cpu->fu_queue_count; ++i)
     {
-        free(cpu);
-        return NULL;
+        event_at(cpu, &event, cpu->fu_queue[i].complete_cycle);
+        event_at(cpu, &event, cpu->fu_queue[i].complete_cycle + 1);
+    }
+    for (i = 0; i < execute->count && execute->executed; ++i)
+    {
+        event_at(cpu, &event, execute->slot[i].complete_cycle);
+        event_at(cpu, &event, execute->slot[i].complete_cycle + 1);
     }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    /* An out-of-order result wakes its readers up and can retire */
+    for (i = 0; i < ooo->rob_count; ++i)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
+        const APEX_RobEntry *entry = &ooo->rob[(ooo->rob_head + i) % cpu->config.rob_size];
 
-        for (i = 0; i < cpu->code_memory_size; ++i)
+        if (entry->issued)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+            event_at(cpu, &event, entry->stage.complete_cycle + 1);
         }
     }
-
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    return cpu;
+    return event;
 }
 
 /*
- * APEX CPU simulation loop
+ * Called after the cycle that started as in snapshot. If no instruction
+ * made progress in it, the cycles that follow repeat it exactly until a
+ * latency ends, and are accounted for at once: the counters and profile
+ * counts it incremented are incremented again for each of them and its
+ * countdowns are advanced. Stalls are attributed as if each had been
+ * simulated.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns the number of cycles skipped, at most limit.
  */
-void APEX_cpu_run(APEX_CPU *cpu)
+static int
+skip_cycles(APEX_CPU *cpu, const APEX_CycleSnapshot *snapshot, int limit)
 {
-    char user_prompt_val;
+    long progress[PROGRESS_WORDS];
+    long *counts = (long *)&cpu->counters;
+    const long *start = (const long *)&snapshot->counters;
+    int memory_step = snapshot->memory_cycles_left - cpu->memory_cycles_left;
+    int fetch_step = snapshot->fetch_cycles_left - cpu->fetch_cycles_left;
+    int event, skip;
+    size_t i;
+
+    progress_signature(cpu, progress);
+    if (memcmp(progress, snapshot->progress, sizeof(progress)) != 0 || memory_step < 0 ||
+        memory_step > 1 || fetch_step < 0 || fetch_step > 1 ||
+        cpu->skip_profile_count > MAX_SKIP_PROFILE)
+    {
+        return 0;
+    }
 
-    while (TRUE)
+    event = next_event(cpu);
+    if (event == INT_MAX)
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock + 1);
-            printf("--------------------------------------------\n");
-        }
+        return 0;
+    }
+    skip = event - cpu->clock - 1;
+    skip = skip < limit ? skip : limit;
+    if (skip <= 0)
+    {
+        return 0;
+    }
 
-        if (APEX_writeback(cpu))
-        {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
-            break;
-        }
+    /* APEX_Counters only holds longs */
+    for (i = 0; i < sizeof(APEX_Counters) / sizeof(long); ++i)
+    {
+        counts[i] += skip * (counts[i] - start[i]);
+    }
+    for (i = 0; i < (size_t)cpu->skip_profile_count; ++i)
+    {
+        *cpu->skip_profile[i] += skip;
+    }
+    cpu->memory_cycles_left -= skip * memory_step;
+    cpu->fetch_cycles_left -= skip * fetch_step;
+    cpu->clock += skip;
+    return skip;
+}
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
+/*
+ * Simulates one clock cycle, of the scalar pipeline, of the superscalar one
+ * in apex_wide.c or of the out-of-order core in apex_ooo.c. When nothing but
+ * latencies counted down in it, up to max_skip more cycles in which the same
+ * happens are skipped, moving the clock on past them.
+ *
+ * Returns TRUE once HALT has retired or on a fault, in which case the clock
+ * is not advanced.
+ */
+static int
+APEX_cpu_cycle(APEX_CPU *cpu, int max_skip)
+{
+    APEX_CycleSnapshot snapshot;
+    int recording;
+    int halted;
+    int i;
 
-        print_reg_file(cpu);
-        printf("--------------\n%s\n--------------\n", "Memory Values:");
-        print_data_memory(cpu);
-        printf("-------\n%s\n-------\n", "Flags:");
-        printf("P = %d\n", cpu->positive_flag);
-        printf("Z = %d\n", cpu->zero_flag);
-        printf("N = %d\n", cpu->negative_flag);
+    /* Per-cycle output, trace events and observed stalls need every cycle
+     * simulated. Cycles are only worth recording once issue has stopped. */
+    recording = FALSE;
+    if (max_skip > 0 && cpu->config.cycle_skip && !cpu->debug_messages && !cpu->trace &&
+        !APEX_OBSERVING(cpu, APEX_EVENT_STALL) && latency_pending(cpu))
+    {
+        long issue_cycles = 0;
 
-        if (cpu->single_step)
+        for (i = 1; i <= MAX_WIDTH; ++i)
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
-
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
-                break;
-            }
+            issue_cycles += cpu->counters.issued[i];
         }
-
-        cpu->clock++;
+        recording = issue_cycles == cpu->skip_issue_cycles;
+        cpu->skip_issue_cycles = issue_cycles;
     }
-}
-void APEX_cpu_simulate(APEX_CPU *cpu, int cycles)
-{
-    while (cycles != 0)
+    if (recording)
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle: %d\n", cpu->clock + 1);
-            printf("--------------------------------------------\n");
-        }
+        snapshot.counters = cpu->counters;
+        progress_signature(cpu, snapshot.progress);
+        snapshot.memory_cycles_left = cpu->memory_cycles_left;
+        snapshot.fetch_cycles_left = cpu->fetch_cycles_left;
+        cpu->skip_recording = TRUE;
+        cpu->skip_profile_count = 0;
+    }
 
-        if (APEX_writeback(cpu))
-        {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
-            break;
-        }
+    APEX_mem_begin_cycle(cpu);
+    cpu->counters.cycles++;
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
-        print_reg_file(cpu);
-        printf("--------------\n%s\n--------------\n", "Memory Values:");
-        print_data_memory(cpu);
-        printf("-------\n%s\n-------\n", "Flags:");
-        printf("P = %d\n", cpu->positive_flag);
-        printf("Z = %d\n", cpu->zero_flag);
-        printf("N = %d\n", cpu->negative_flag);
-        cpu->clock++;
-        cycles--;
+    if (cpu->config.core == CORE_OOO)
+    {
+        halted = APEX_ooo_cycle(cpu);
+    }
+    else
+    {
+        halted = cpu->config.width > 1 ? APEX_wide_cycle(cpu) : pipeline_cycle(cpu);
+    }
+    cpu->skip_recording = FALSE;
+    if (halted)
+    {
+        return TRUE;
+    }
+    if (recording)
+    {
+        skip_cycles(cpu, &snapshot, max_skip);
     }
+    return FALSE;
 }
-void APEX_cpu_display(APEX_CPU *cpu)
+
+/*
+ * Simulates the next clock cycle, and up to limit - 1 cycles after it in
+ * which only latencies count down. The clock stays on the cycle in which
+ * the program ended.
+ *
+ * Returns the APEX_STATUS_* of the cpu afterwards.
+ */
+int
+APEX_cpu_advance(APEX_CPU *cpu, long limit)
 {
-    while (TRUE)
+    if (cpu->status != APEX_STATUS_RUNNING || limit <= 0)
+    {
+        return cpu->status;
+    }
+    if (APEX_cpu_cycle(cpu, limit - 1 < INT_MAX ? (int)(limit - 1) : INT_MAX))
+    {
+        cpu->status = cpu->mem_fault     ? APEX_STATUS_FAULT
+                      : cpu->fetch_fault ? APEX_STATUS_FETCH_FAULT
+                                         : APEX_STATUS_HALTED;
+    }
+    else
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle: %d\n", cpu->clock + 1);
-            printf("--------------------------------------------\n");
-        }
-
-        if (APEX_writeback(cpu))
-        {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
-            break;
-        }
-
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
-        print_reg_file(cpu);
-        printf("--------------\n%s\n--------------\n", "Memory Values:");
-        print_data_memory(cpu);
-        printf("-------\n%s\n-------\n", "Flags:");
-        printf("P = %d\n", cpu->positive_flag);
-        printf("Z = %d\n", cpu->zero_flag);
-        printf("N = %d\n", cpu->negative_flag);
         cpu->clock++;
     }
+    return cpu->status;
 }
-void APEX_cpu_show_mem(APEX_CPU *cpu, int mem_loc)
+
+/*
+ * Simulates up to cycles clock cycles, stopping early when the program
+ * ends. This is the only way the cpu is advanced, the drivers in
+ * apex_driver.c and the library in apex_lib.c are built on it.
+ *
+ * Returns the APEX_STATUS_* of the cpu afterwards.
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu, long cycles)
 {
-    while (TRUE)
+    int start;
+
+    while (cycles > 0 && cpu->status == APEX_STATUS_RUNNING)
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle: %d\n", cpu->clock + 1);
-            printf("--------------------------------------------\n");
-        }
-        if (APEX_writeback(cpu))
-        {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
-            break;
-        }
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
-        print_reg_file(cpu);
-        printf("--------------\n%s\n--------------\n", "Memory Values:");
-        print_data_memory(cpu);
-        printf("-------\n%s\n-------\n", "Flags:");
-        printf("P = %d\n", cpu->positive_flag);
-        printf("Z = %d\n", cpu->zero_flag);
-        printf("N = %d\n", cpu->negative_flag);
-        cpu->clock++;
+        start = cpu->clock;
+        APEX_cpu_advance(cpu, cycles);
+
+        /* Cycles skipped over are part of the count */
+        cycles -= cpu->clock - start;
     }
-    printf("\nValue at Memory Location is MEM[%d]  = %d\n", mem_loc, cpu->data_memory[mem_loc]);
+    return cpu->status;
 }
+
 /*
  * This function deallocates APEX CPU.
  *
@@ -1199,6 +1584,14 @@ void APEX_cpu_show_mem(APEX_CPU *cpu, int mem_loc)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
-    free(cpu->code_memory);
+    if (!cpu->code_memory_shared)
+    {
+        release_code_memory(cpu->code_memory, cpu->code_memory_map, cpu->code_memory_map_size);
+    }
+    APEX_trace_close(cpu);
+    APEX_mem_release(cpu);
+    APEX_cache_free(&cpu->dcache);
+    APEX_cache_free(&cpu->icache);
+    free(cpu->profile);
     free(cpu);
-}
\ No newline at end of file
+}
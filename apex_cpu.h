@@ -9,12 +9,17 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "apex.h"
 #include "apex_macros.h"
 
-/* Format of an APEX instruction  */
+/* Format of a pre-decoded APEX instruction, the mnemonic is only looked up
+ * from the opcode when printing */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
     int opcode;
     int rd;
     int rs1;
@@ -22,41 +27,392 @@ typedef struct APEX_Instruction
     int imm;
 } APEX_Instruction;
 
-/* Model of CPU stage latch */
+/* Model of CPU stage latch, the instruction fields are referenced from code
+ * memory instead of being copied down the pipeline */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
-    int opcode;
-    int rs1;
-    int rs2;
-    int rd;
-    int imm;
+    const APEX_Instruction *insn;
     int rs1_value;
     int rs2_value;
     int result_buffer;
     int memory_address;
     int has_insn;
+    int predicted_pc; /* Pc fetch continued from after this instruction */
+    long seq;         /* Dynamic instruction number, assigned in fetch */
+    int complete_cycle; /* Cycle its functional unit produces the result */
+    int rs1_path;     /* BYPASS_* the source operands were read from */
+    int rs2_path;
 } CPU_Stage;
 
+/* Register operands read in Decode/RF */
+#define SRC_RS1 0x1
+#define SRC_RS2 0x2
+
+/* Paths a source operand is read from */
+#define BYPASS_REGISTER_FILE 0x0
+#define BYPASS_EX_MEM 0x1     /* Result of an operation that left its unit */
+#define BYPASS_MEM_WB 0x2     /* Result in the MEM/WB latch, loaded values */
+#define BYPASS_STORE_DATA 0x3 /* Store data read late, in the Memory stage */
+#define NUM_BYPASS_PATHS 0x4
+#define BYPASS_STALL (-1)     /* Not computed yet */
+
+/* Condition flags, as updated by an instruction or tested by a branch */
+#define FLAG_Z 0x1
+#define FLAG_P 0x2
+#define FLAG_N 0x4
+#define FLAG_ALL (FLAG_Z | FLAG_P | FLAG_N)
+
+/* Data memory access performed in the Memory stage */
+#define MEM_NONE 0x0
+#define MEM_LOAD 0x1
+#define MEM_STORE 0x2
+
+/* Control transfer performed in Execute */
+#define CTRL_NONE 0x0
+#define CTRL_PC_REL 0x1  /* Taken target is pc + imm */
+#define CTRL_REG 0x2     /* Taken target is rs1 + imm */
+
+/* Registers written in Writeback, and made available for forwarding */
+#define DST_RD 0x1
+#define DST_RS1_POST 0x2 /* rs1 += 4, LOADP */
+#define DST_RS2_POST 0x4 /* rs2 += 4, STOREP */
+
+/* Functional units in Execute */
+#define FU_ALU 0x0 /* Integer, logical and control instructions */
+#define FU_MUL 0x1
+#define FU_DIV 0x2
+#define FU_AGU 0x3 /* Address generation of LOAD/STORE */
+#define NUM_FUS 0x4
+
+typedef void (*APEX_ExecFn)(CPU_Stage *stage);
+
+/* Per-opcode behaviour, the stage functions dispatch through this table
+ * instead of switching on the opcode */
+typedef struct APEX_OpInfo
+{
+    unsigned char src;        /* SRC_* operands read in decode */
+    unsigned char flags;      /* FLAG_* updated from result_buffer */
+    unsigned char mem;        /* MEM_* access */
+    unsigned char ctrl;       /* CTRL_* target computation */
+    unsigned char cond_flags; /* FLAG_* tested by a branch, 0 if always taken */
+    unsigned char cond_value; /* Taken when the tested flag equals this */
+    unsigned char dst;        /* DST_* registers written */
+    unsigned char unit;       /* FU_* executing it */
+    APEX_ExecFn exec;         /* Computes result_buffer or memory_address */
+} APEX_OpInfo;
+
+extern const APEX_OpInfo apex_op_table[NUM_OPCODES];
+
+/* Stage in which branches are resolved */
+#define BRANCH_STAGE_EXECUTE 0x0
+#define BRANCH_STAGE_DECODE 0x1
+
+/* Branch direction predictors */
+#define PREDICTOR_NONE 0x0    /* Always fall through, taken branches redirect */
+#define PREDICTOR_STATIC 0x1  /* Backward taken, forward not taken */
+#define PREDICTOR_BIMODAL 0x2 /* 2-bit counters indexed by pc */
+#define PREDICTOR_GSHARE 0x3  /* 2-bit counters indexed by pc ^ history */
+
+/* Core models */
+#define CORE_INORDER 0x0 /* Scalar or superscalar in-order pipeline */
+#define CORE_OOO 0x1     /* Out-of-order core, see apex_ooo.c */
+
+/* Cache replacement policies */
+#define CACHE_LRU 0x0
+#define CACHE_RANDOM 0x1
+
+/* Cache geometry and timing, sizes are in words */
+typedef struct APEX_CacheConfig
+{
+    long size;        /* Power of two, 0 disables the cache */
+    int assoc;        /* Ways per set */
+    int line_size;    /* Words per line */
+    int replacement;  /* CACHE_* */
+    int write_back;   /* {TRUE, FALSE} Write-back or write-through */
+    int hit_latency;  /* Cycles of a hit */
+    int miss_latency; /* Cycles of a refill, or of writing back a dirty line */
+    int prefetch;     /* {TRUE, FALSE} Fill the next line on every access */
+} APEX_CacheConfig;
+
+typedef struct APEX_CacheLine
+{
+    unsigned long tag;
+    unsigned long last_use; /* Access count at the last hit or fill, for LRU */
+    int valid;
+    int dirty;
+} APEX_CacheLine;
+
+/* Set-associative cache timing model, see apex_cache.c */
+typedef struct APEX_Cache
+{
+    APEX_CacheConfig config;
+    APEX_CacheLine *lines; /* num_sets * assoc lines, set by set */
+    long num_sets;
+    unsigned int random_state;
+    long accesses;
+    long hits;
+    long misses;
+    long evictions;
+    long writebacks;
+    long prefetches;       /* Lines filled by the next-line prefetcher */
+} APEX_Cache;
+
+/* Timing of one functional unit */
+typedef struct APEX_FUConfig
+{
+    int latency;   /* Cycles from issue to result */
+    int pipelined; /* {TRUE, FALSE} Accepts an operation every cycle */
+} APEX_FUConfig;
+
+/* Run-time microarchitecture parameters */
+typedef struct APEX_Config
+{
+    int memory_latency; /* Cycles a LOAD/STORE occupies the Memory stage */
+    int forwarding;     /* {TRUE, FALSE} Bypass results to decode */
+    int branch_stage;   /* BRANCH_STAGE_* */
+    long memory_size;   /* Data memory size in integers */
+    int predictor;      /* PREDICTOR_* */
+    int btb_entries;    /* Power of two, up to MAX_BTB_ENTRIES */
+    int bp_entries;     /* 2-bit counters, power of two up to MAX_BP_ENTRIES */
+    int history_bits;   /* Global history length used by gshare */
+    APEX_CacheConfig dcache; /* L1 data cache used by the Memory stage */
+    APEX_CacheConfig icache; /* Instruction cache used by Fetch */
+    APEX_FUConfig fu[NUM_FUS]; /* Indexed by FU_* */
+    int width;          /* Instructions per stage per cycle, 1 is the scalar pipeline */
+    int rf_read_ports;  /* Register file reads per cycle when width > 1, 0 for 2 * width */
+    int core;           /* CORE_* */
+    int rob_size;       /* Out-of-order core window, up to MAX_ROB_SIZE */
+    int iq_size;        /* Unified issue queue entries, up to MAX_IQ_SIZE */
+    int lsq_size;       /* Load/store queue entries, up to MAX_LSQ_SIZE */
+    int phys_regs;      /* Physical registers, the flags are renamed too */
+    int cycle_skip;     /* {TRUE, FALSE} Jump over cycles that only count latencies down */
+} APEX_Config;
+
+typedef struct APEX_BTBEntry
+{
+    int valid;
+    int pc;
+    int target;
+} APEX_BTBEntry;
+
+/* Branch prediction state, sized for the largest configuration */
+typedef struct APEX_BranchPredictor
+{
+    APEX_BTBEntry btb[MAX_BTB_ENTRIES];
+    unsigned char counters[MAX_BP_ENTRIES];
+    unsigned int history;
+} APEX_BranchPredictor;
+
+typedef struct APEX_MemTable APEX_MemTable;
+typedef struct APEX_MemChunk APEX_MemChunk;
+
+/* Sparse data memory, pages are allocated on first write */
+typedef struct APEX_DataMemory
+{
+    APEX_MemTable *directory[MEM_DIR_ENTRIES];
+    APEX_MemChunk *arena;  /* Chunks the pages are carved from */
+    long num_pages;        /* Pages allocated so far */
+    long last_page_number; /* One-entry lookup cache */
+    int *last_page;
+    int *touched;          /* Addresses ever written, see APEX_mem_touched */
+    long num_touched;
+    long touched_capacity;
+    int touched_unsorted;  /* touched is not in address order */
+} APEX_DataMemory;
+
+/* Pipeline stages, as indexed in APEX_Counters */
+#define STAGE_FETCH 0x0
+#define STAGE_DECODE 0x1
+#define STAGE_EXECUTE 0x2
+#define STAGE_MEMORY 0x3
+#define STAGE_WRITEBACK 0x4
+#define NUM_STAGES 0x5
+
+/* Reasons a stage holds its instruction for a cycle */
+#define STALL_LOAD_USE 0x0       /* Decode waits for a loaded or multi-cycle result */
+#define STALL_RAW 0x1            /* Decode waits for a writeback, no forwarding */
+#define STALL_EXECUTE_BUSY 0x2   /* Decode is ready but Execute is occupied */
+#define STALL_MEMORY_BUSY 0x3    /* Execute waits for the Memory stage */
+#define STALL_MEMORY_LATENCY 0x4 /* Memory waits for its data memory access */
+#define STALL_ICACHE 0x5         /* Fetch waits for the instruction cache */
+#define STALL_FU_BUSY 0x6        /* Execute waits for a functional unit */
+#define STALL_STRUCTURAL 0x7     /* Decode ran out of read ports or units for its group */
+#define STALL_ROB_FULL 0x8       /* Rename waits for a reorder buffer entry */
+#define STALL_IQ_FULL 0x9        /* Rename waits for an issue queue entry */
+#define STALL_LSQ_FULL 0xa       /* Rename waits for a load/store queue entry */
+#define STALL_FREE_LIST 0xb      /* Rename waits for a free physical register */
+#define NUM_STALL_CAUSES 0xc
+
+/* Performance counters, counted over the cycles simulated by this cpu */
+typedef struct APEX_Counters
+{
+    long cycles;                       /* Cycles simulated */
+    long retired;                      /* Instructions retired */
+    long stalls[NUM_STALL_CAUSES];     /* Stall cycles by STALL_* cause */
+    long flushed;                      /* Instructions squashed by taken branches */
+    long fetch_bubbles;                /* Cycles fetch skipped after a redirect */
+    long branches;                     /* Control instructions resolved */
+    long taken_branches;
+    long mispredicts;                  /* Resolved to another pc than fetch chose */
+    long retired_by_opcode[NUM_OPCODES];
+    long occupancy[NUM_STAGES];        /* Cycles each stage held an instruction */
+    long fu_issued[NUM_FUS];           /* Operations started on each unit */
+    long fu_busy[NUM_FUS];             /* Cycles each unit computed at least one */
+    long bypass[NUM_BYPASS_PATHS];     /* Source operands read from each path */
+    long issued[MAX_WIDTH + 1];        /* Cycles decode issued n > 0 instructions */
+    long rob_entries;                  /* Out-of-order window entries, summed every cycle */
+    long iq_entries;
+    long lsq_entries;
+    long store_forwards;               /* Loads given the data of an older store */
+} APEX_Counters;
+
+/* Per-instruction profile, one entry per code memory instruction */
+typedef struct APEX_PcProfile
+{
+    long cycles;     /* Cycles charged to this instruction */
+    long stalls;     /* Cycles this instruction was held by a hazard */
+    long executions; /* Times retired */
+    long flushes;    /* Fetch slots lost to its taken redirects */
+} APEX_PcProfile;
+
+extern const char *const apex_stage_names[NUM_STAGES];
+extern const char *const apex_stall_cause_names[NUM_STALL_CAUSES];
+extern const char *const apex_fu_names[NUM_FUS];
+extern const char *const apex_bypass_names[NUM_BYPASS_PATHS];
+
+/* Pipeline trace events */
+#define TRACE_STAGE 0x0 /* Stage processed or held its instruction */
+#define TRACE_STALL 0x1 /* Stage held its instruction, aux is the STALL_* cause */
+#define TRACE_FLUSH 0x2 /* Taken redirect by pc, aux is the instructions squashed */
+
+/* Fixed-size trace record, see apex_trace.c for the file layout */
+typedef struct APEX_TraceRecord
+{
+    int32_t cycle;
+    int32_t pc;
+    uint32_t seq;  /* Low bits of the dynamic instruction number */
+    uint8_t stage; /* STAGE_* */
+    uint8_t event; /* TRACE_* */
+    uint8_t aux;
+    uint8_t reserved;
+} APEX_TraceRecord;
+
+/* Records are buffered in memory and written in large blocks */
+typedef struct APEX_Trace
+{
+    FILE *fp;
+    int first_cycle; /* Only cycles in [first_cycle, last_cycle] are recorded */
+    int last_cycle;
+    int count;
+    int failed; /* A write failed, the trace is incomplete */
+    APEX_TraceRecord records[TRACE_BUFFER_RECORDS];
+} APEX_Trace;
+
+extern const char *const apex_stage_titles[NUM_STAGES];
+
+/* Instructions a stage of the superscalar pipeline holds, oldest first */
+typedef struct APEX_StageGroup
+{
+    CPU_Stage slot[MAX_WIDTH];
+    int count;
+    int executed; /* Execute has computed the group */
+    int flags;    /* FLAG_* bits set as Execute started computing it */
+} APEX_StageGroup;
+
+/* Instruction in the reorder buffer of the out-of-order core. Its
+ * destinations are indexed rd, post-incremented register, flags. */
+typedef struct APEX_RobEntry
+{
+    CPU_Stage stage;
+    int src[3];       /* Physical registers read for rs1, rs2, flags, -1 if none */
+    int dst[3];       /* Physical registers written, -1 if none */
+    int arch_dst[3];  /* Architectural register of each, REG_FILE_SIZE for the flags */
+    int old_dst[3];   /* Previous mappings, freed at retirement */
+    int issued;       /* Left the issue queue */
+    int mem_pending;  /* A LOAD with its address, waiting for data memory */
+    int fault;        /* The data memory access is outside data memory */
+} APEX_RobEntry;
+
+/* Rename, scheduling and retirement state of the out-of-order core */
+typedef struct APEX_OutOfOrder
+{
+    int active;                              /* Set up from the architectural state */
+    int rename_map[REG_FILE_SIZE + 1];       /* The flags are mapped last */
+    int phys_value[MAX_PHYS_REGS];
+    int phys_ready_cycle[MAX_PHYS_REGS];     /* First cycle a reader can issue */
+    int free_list[MAX_PHYS_REGS];
+    int free_count;
+    APEX_RobEntry rob[MAX_ROB_SIZE];         /* Circular, rob_head is the oldest */
+    int rob_head;
+    int rob_count;
+    int iq[MAX_IQ_SIZE];                     /* Reorder buffer indices, oldest first */
+    int iq_count;
+    int lsq[MAX_LSQ_SIZE];                   /* Reorder buffer indices of LOAD/STORE */
+    int lsq_count;
+    int unit_busy_until[NUM_FUS];            /* Last cycle each unit computes */
+    int mem_port_free_cycle;                 /* First cycle data memory accepts an access */
+} APEX_OutOfOrder;
+
+/* Callback registered for some APEX_EVENT_*, see APEX_cpu_observe */
+typedef struct APEX_Observer
+{
+    unsigned int events; /* 0 if the slot is free */
+    apex_observer fn;
+    void *arg;
+} APEX_Observer;
+
 /* Model of APEX CPU */
-typedef struct APEX_CPU
+struct APEX_CPU
 {
     int pc;                  /* Current program counter */
     int clock;               /* Clock cycles elapsed */
     int insn_completed;      /* Instructions retired */
+    long insn_fast_forwarded; /* Instructions executed by the functional model */
+    long insn_fetched;       /* Instructions fetched, numbers CPU_Stage seq */
     int regs[REG_FILE_SIZE]; /* Integer register file */
-    int fwd_values[2][REG_FILE_SIZE];
-    int flag[REG_FILE_SIZE];
+    long reg_producer[REG_FILE_SIZE]; /* Seq of the youngest in-flight writer, 0 if none */
     int code_memory_size;              /* Number of instruction in the input file */
     APEX_Instruction *code_memory;     /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    void *code_memory_map;             /* Mapping backing code memory, NULL if allocated */
+    size_t code_memory_map_size;
+    int code_memory_shared;            /* Code memory is owned by the caller */
+    APEX_DataMemory data_memory;       /* Data Memory */
+    int mem_fault;                     /* An access fell outside data memory */
+    int mem_fault_pc;
+    int mem_fault_address;
+    int fetch_fault;                   /* Fetch reached a pc outside code memory */
+    int fetch_fault_pc;
+    int status;                        /* APEX_STATUS_*, see APEX_cpu_step */
+    int data_memory_changed[MAX_MEM_CHANGES_PER_CYCLE]; /* Words written this cycle */
+    int num_changed;                   /* May exceed the words recorded */
+    int mem_changes_only;              /* Per-cycle display shows only changed words */
     int single_step;                   /* Wait for user input after every cycle */
+    int debug_messages;                /* Print stage contents and state every cycle */
+    FILE *out;                         /* Sink for all simulator output */
+    FILE *diag;                        /* Sink for warnings and errors about the run */
     int zero_flag;                     /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int positive_flag;
     int negative_flag;
-    int stall_flag;
     int fetch_from_next_cycle;
+    int memory_cycles_left;            /* Remaining cycles of the access in Memory */
+    int fetch_cycles_left;             /* Remaining cycles of the I-cache access */
+    int fu_free_cycle[NUM_FUS];        /* First cycle each unit accepts an operation */
+    int fu_queue_count;
+    APEX_Config config;
+    APEX_Counters counters;
+    APEX_BranchPredictor bpred;
+    APEX_Cache dcache;                 /* Set up at the first access */
+    APEX_Cache icache;
+    APEX_PcProfile *profile;           /* NULL unless profiling is enabled */
+    APEX_Trace *trace;                 /* NULL unless tracing is enabled */
+
+    /* Profile counts incremented by a cycle that may be skipped over, set
+     * while skip_recording, see APEX_profile_count */
+    int skip_recording;
+    int skip_profile_count;
+    long *skip_profile[MAX_SKIP_PROFILE];
+    long skip_issue_cycles;            /* Issuing cycles as the last cycle with a latency pending started */
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -64,13 +420,120 @@ typedef struct APEX_CPU
     CPU_Stage execute;
     CPU_Stage memory;
     CPU_Stage writeback;
-} APEX_CPU;
 
-APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
+    /* Operations issued by Execute, oldest first, that have not yet moved
+     * to the Memory stage */
+    CPU_Stage fu_queue[MAX_FU_IN_FLIGHT];
+
+    /* Stages of the superscalar pipeline, indexed by STAGE_*, used instead
+     * of the latches above when config.width > 1 */
+    APEX_StageGroup wide[NUM_STAGES];
+
+    /* Back end used instead of Decode to Writeback with config.core
+     * CORE_OOO, fetch is the superscalar one */
+    APEX_OutOfOrder ooo;
+
+    /* Instrumentation, see APEX_OBSERVE */
+    APEX_Observer observers[MAX_OBSERVERS];
+    unsigned int observed_events;      /* APEX_EVENT_* some observer is registered for */
+};
+
+/* Tests whether any observer is registered for the APEX_EVENT_* type, always
+ * FALSE when the hooks are compiled out */
+#define APEX_OBSERVING(cpu, type) (ENABLE_OBSERVERS && ((cpu)->observed_events & (type)))
+
+/* Hook reporting an event about the instruction in stage to its observers.
+ * The core pays a test for it while nobody observes the event, and nothing
+ * with ENABLE_OBSERVERS 0. */
+#define APEX_OBSERVE(cpu, type, stage_id, stage, detail, address, value)                  \
+    do                                                                                     \
+    {                                                                                      \
+        if (APEX_OBSERVING(cpu, type))                                                     \
+        {                                                                                  \
+            APEX_observer_event(cpu, type, stage_id, stage, detail, address, value);       \
+        }                                                                                  \
+    } while (0)
+
+APEX_Instruction *create_code_memory(const char *filename, int *size, FILE *diag);
+APEX_Instruction *parse_code_memory(const char *buffer, size_t length, const char *name, int *size,
+                                    FILE *diag);
+APEX_Instruction *load_code_memory(const char *filename, int *size, void **map, size_t *map_size,
+                                   FILE *diag);
+void release_code_memory(APEX_Instruction *code_memory, void *map, size_t map_size);
+int write_code_image(const char *filename, const APEX_Instruction *code_memory, int size);
+int validate_code_memory(const APEX_Instruction *code_memory, int size, const char *name,
+                         FILE *diag);
+const char *get_opcode_str(int opcode);
+void print_instruction(FILE *out, const APEX_Instruction *ins);
+void APEX_config_default(APEX_Config *config);
+int APEX_config_set(APEX_Config *config, const char *name, const char *value);
+int APEX_config_valid(const APEX_Config *config);
+APEX_CPU *APEX_cpu_alloc(void);
+APEX_CPU *APEX_cpu_init(const char *filename, FILE *diag);
+APEX_CPU *APEX_cpu_init_shared(APEX_Instruction *code_memory, int code_memory_size);
+int APEX_cpu_advance(APEX_CPU *cpu, long limit);
+int APEX_cpu_step(APEX_CPU *cpu, long cycles);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
 void APEX_cpu_simulate(APEX_CPU *cpu, int cycles);
 void APEX_cpu_display(APEX_CPU *cpu);
 void APEX_cpu_show_mem(APEX_CPU *cpu, int mem_loc);
+void APEX_cpu_batch(APEX_CPU *cpu);
+int APEX_cpu_enable_profile(APEX_CPU *cpu);
+void APEX_cpu_print_profile(const APEX_CPU *cpu, FILE *fp);
+void APEX_stage_event(APEX_CPU *cpu, int stage_id, const CPU_Stage *stage);
+void APEX_trace_event(APEX_CPU *cpu, int stage_id, int event, const CPU_Stage *stage, int aux);
+void APEX_count_stall(APEX_CPU *cpu, int cause, int stage_id, const CPU_Stage *stage);
+int APEX_cpu_observe(APEX_CPU *cpu, unsigned int events, apex_observer fn, void *arg);
+void APEX_cpu_unobserve(APEX_CPU *cpu, int handle);
+void APEX_observer_event(APEX_CPU *cpu, int type, int stage_id, const CPU_Stage *stage, int detail,
+                         int address, int value);
+APEX_PcProfile *APEX_profile_entry(const APEX_CPU *cpu, int pc);
+int APEX_code_index(const APEX_CPU *cpu, int pc);
+int APEX_fetch_faulted(APEX_CPU *cpu, int drained);
+void APEX_profile_count(APEX_CPU *cpu, long *count);
+int APEX_stage_result(const CPU_Stage *stage, int reg, int loaded, int *value);
+int APEX_fetch_latency(APEX_CPU *cpu, int pc);
+int APEX_data_access_latency(APEX_CPU *cpu, int address, int is_write);
+int APEX_resolve_branch(APEX_CPU *cpu, const CPU_Stage *branch, const APEX_OpInfo *op, int taken);
+int APEX_wide_cycle(APEX_CPU *cpu);
+void APEX_wide_fetch(APEX_CPU *cpu);
+int APEX_ooo_cycle(APEX_CPU *cpu);
+void APEX_update_flags(APEX_CPU *cpu, int mask, int result);
+int APEX_branch_taken(const APEX_CPU *cpu, const APEX_OpInfo *op);
+int APEX_flags_from_result(int flags, int mask, int result);
+int APEX_condition_holds(int flags, const APEX_OpInfo *op);
+long APEX_cpu_fast_forward(APEX_CPU *cpu, long count);
+int APEX_mem_in_range(const APEX_CPU *cpu, int address);
+int APEX_mem_read(APEX_CPU *cpu, int address, int *value);
+int APEX_mem_write(APEX_CPU *cpu, int address, int value);
+void APEX_mem_begin_cycle(APEX_CPU *cpu);
+const int *APEX_mem_next_page(const APEX_CPU *cpu, long *page_number);
+const int *APEX_mem_touched(APEX_CPU *cpu, long *count);
+int APEX_mem_load_page(APEX_CPU *cpu, long page_number, const int *words);
+void APEX_mem_release(APEX_CPU *cpu);
+void APEX_cache_config_default(APEX_CacheConfig *config);
+int APEX_cache_config_set(APEX_CacheConfig *config, const char *name, const char *value);
+int APEX_cache_config_valid(const APEX_CacheConfig *config);
+int APEX_cache_init(APEX_Cache *cache, const APEX_CacheConfig *config);
+void APEX_cache_free(APEX_Cache *cache);
+int APEX_cache_access(APEX_Cache *cache, unsigned long address, int is_write);
+void APEX_bp_reset(APEX_CPU *cpu);
+int APEX_bp_predict(APEX_CPU *cpu, int pc, const APEX_Instruction *ins);
+void APEX_bp_update(APEX_CPU *cpu, int pc, int taken, int target);
+int APEX_trace_open(APEX_CPU *cpu, const char *filename, int first_cycle, int last_cycle);
+void APEX_trace_flush(APEX_Trace *trace);
+int APEX_trace_close(APEX_CPU *cpu);
+const APEX_TraceRecord *APEX_trace_map(const char *filename, const APEX_Instruction **code_memory,
+                                       int *code_memory_size, long *num_records,
+                                       void **map, size_t *map_size);
+void APEX_stats_write_json(const APEX_CPU *cpu, FILE *fp);
+void APEX_stats_write_csv(const APEX_CPU *cpu, FILE *fp);
+int APEX_checkpoint_is_file(const char *filename);
+int APEX_checkpoint_save(const APEX_CPU *cpu, const char *filename);
+int APEX_checkpoint_restore(APEX_CPU *cpu, const char *filename);
+int APEX_batch_run_programs(const char *list_file, const APEX_Config *config,
+                            int num_threads, const char *log_prefix);
+int APEX_batch_sweep(const char *filename, const char *grid, const APEX_Config *base,
+                     int num_threads);
 #endif
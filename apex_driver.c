@@ -0,0 +1,435 @@
+/*
+ * apex_driver.c
+ * Contains the drivers of apex_sim, which step the cpu and print its state,
+ * prompt between cycles and summarize the run. The cpu itself does no I/O
+ * besides the debug stage contents, see apex.h for embedding it.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Debug function which prints the register file
+ *
+ * Note: You are not supposed to edit this function
+ */
+static void
+print_reg_file(const APEX_CPU *cpu)
+{
+    int i;
+
+    fprintf(cpu->out, "----------\n%s\n----------\n", "Registers:");
+
+    for (int i = 0; i < REG_FILE_SIZE / 2; ++i)
+    {
+        fprintf(cpu->out, "R%-1d[%-1d] ", i, cpu->regs[i]);
+    }
+
+    fprintf(cpu->out, "\n");
+
+    for (i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
+    {
+        fprintf(cpu->out, "R%-1d[%-1d] ", i, cpu->regs[i]);
+    }
+
+    fprintf(cpu->out, "\n");
+}
+/* Prints the non-zero data memory words in address order, visiting only
+ * the words that have been written */
+static void
+print_data_memory(APEX_CPU *cpu)
+{
+    const int *touched;
+    long num_touched, i;
+    int value, count = 0;
+
+    touched = APEX_mem_touched(cpu, &num_touched);
+    for (i = 0; i < num_touched; ++i)
+    {
+        APEX_mem_read(cpu, touched[i], &value);
+        if (value != 0)
+        {
+            fprintf(cpu->out, "MEM[%d] = %d\n", touched[i], value);
+            count++;
+        }
+    }
+    if (count == 0)
+    {
+        fprintf(cpu->out, "All the memory values are zeros\n");
+    }
+}
+
+/* Prints only the data memory words written in the current cycle */
+static void
+print_data_memory_changes(APEX_CPU *cpu)
+{
+    int i;
+
+    for (i = 0; i < cpu->num_changed && i < MAX_MEM_CHANGES_PER_CYCLE; ++i)
+    {
+        int address = cpu->data_memory_changed[i];
+        int value = 0;
+
+        APEX_mem_read(cpu, address, &value);
+        fprintf(cpu->out, "MEM[%d] = %d\n", address, value);
+    }
+    if (cpu->num_changed > MAX_MEM_CHANGES_PER_CYCLE)
+    {
+        fprintf(cpu->out, "... %d more memory values changed\n",
+                cpu->num_changed - MAX_MEM_CHANGES_PER_CYCLE);
+    }
+    if (cpu->num_changed == 0)
+    {
+        fprintf(cpu->out, "No memory values changed\n");
+    }
+}
+
+/* Prints the architectural state visible after a cycle: registers, data
+ * memory and condition flags */
+static void
+print_cpu_state(APEX_CPU *cpu)
+{
+    print_reg_file(cpu);
+    if (cpu->mem_changes_only)
+    {
+        fprintf(cpu->out, "---------------\n%s\n---------------\n", "Memory Changes:");
+        print_data_memory_changes(cpu);
+    }
+    else
+    {
+        fprintf(cpu->out, "--------------\n%s\n--------------\n", "Memory Values:");
+        print_data_memory(cpu);
+    }
+    fprintf(cpu->out, "-------\n%s\n-------\n", "Flags:");
+    fprintf(cpu->out, "P = %d\n", cpu->positive_flag);
+    fprintf(cpu->out, "Z = %d\n", cpu->zero_flag);
+    fprintf(cpu->out, "N = %d\n", cpu->negative_flag);
+}
+
+static void
+print_code_memory(const APEX_CPU *cpu)
+{
+    int i;
+
+    fprintf(cpu->out, "%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+                      "imm");
+
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        fprintf(cpu->out, "%-9s %-9d %-9d %-9d %-9d\n", get_opcode_str(cpu->code_memory[i].opcode),
+                          cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                          cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+    }
+}
+/*
+ * This function creates and initializes APEX cpu. Messages about loading
+ * the program, and later warnings and errors about the run, go to diag.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *filename, FILE *diag)
+{
+    APEX_CPU *cpu;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    cpu = APEX_cpu_alloc();
+
+    if (!cpu)
+    {
+        return NULL;
+    }
+    cpu->diag = diag;
+
+    /* Resume from a checkpoint, which carries its own code memory */
+    if (APEX_checkpoint_is_file(filename))
+    {
+        if (APEX_checkpoint_restore(cpu, filename) != 0)
+        {
+            free(cpu);
+            return NULL;
+        }
+
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            fprintf(diag,
+                    "APEX_CPU: Restored APEX CPU from checkpoint, %d instructions\n",
+                    cpu->code_memory_size);
+            fprintf(diag, "APEX_CPU: Resuming at cycle %d, PC = %d\n",
+                    cpu->clock, cpu->pc);
+        }
+        return cpu;
+    }
+
+    /* Map a binary program image, or parse an assembly file */
+    cpu->code_memory = load_code_memory(filename, &cpu->code_memory_size,
+                                        &cpu->code_memory_map, &cpu->code_memory_map_size,
+                                        diag);
+    if (!cpu->code_memory)
+    {
+        free(cpu);
+        return NULL;
+    }
+
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        fprintf(diag,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(diag, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+    }
+    return cpu;
+}
+
+/* Prints code memory annotated with the per-instruction profile */
+void
+APEX_cpu_print_profile(const APEX_CPU *cpu, FILE *fp)
+{
+    long total = 0;
+    int i;
+
+    if (!cpu->profile)
+    {
+        return;
+    }
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        total += cpu->profile[i].cycles;
+    }
+
+    fprintf(fp, "APEX_CPU: Profile, cycles = %ld instructions = %ld\n",
+            cpu->counters.cycles, cpu->counters.retired);
+    fprintf(fp, "%9s %7s %9s %9s %9s  %-6s %s\n", "cycles", "%", "stalls", "execs",
+            "flushes", "pc", "instruction");
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const APEX_PcProfile *entry = &cpu->profile[i];
+
+        fprintf(fp, "%9ld %6.2f%% %9ld %9ld %9ld  %-6d ", entry->cycles,
+                total ? 100.0 * entry->cycles / total : 0.0, entry->stalls,
+                entry->executions, entry->flushes, 4000 + 4 * i);
+        print_instruction(fp, &cpu->code_memory[i]);
+        fprintf(fp, "\n");
+    }
+}
+
+/* Runs without a cache whose geometry has too few lines for one set, as
+ * the cpu would do silently at its first access */
+static void
+check_caches(APEX_CPU *cpu)
+{
+    if (!APEX_cache_config_valid(&cpu->config.icache))
+    {
+        fprintf(cpu->diag, "APEX_Error: Invalid instruction cache geometry, running without it\n");
+        cpu->config.icache.size = 0;
+    }
+    if (!APEX_cache_config_valid(&cpu->config.dcache))
+    {
+        fprintf(cpu->diag, "APEX_Error: Invalid data cache geometry, running without it\n");
+        cpu->config.dcache.size = 0;
+    }
+}
+
+/*
+ * Simulation loop shared by every mode. Runs cycles clock cycles, or to the
+ * end of the program when cycles is negative. With debug messages the state
+ * is printed after every cycle under the heading label, and with prompt the
+ * user is asked before the next one; otherwise the cpu is stepped in one
+ * go.
+ *
+ * Returns the APEX_STATUS_* the cpu was left in.
+ */
+static int
+drive(APEX_CPU *cpu, long cycles, int prompt, const char *label)
+{
+    int debug = ENABLE_DEBUG_MESSAGES && cpu->debug_messages;
+    int status = cpu->status;
+    char user_prompt_val;
+
+    if (debug && cpu->clock == 0)
+    {
+        fprintf(cpu->diag, "APEX_CPU: Printing Code Memory\n");
+        print_code_memory(cpu);
+    }
+    check_caches(cpu);
+
+    while (status == APEX_STATUS_RUNNING && cycles != 0)
+    {
+        if (!debug && !prompt)
+        {
+            status = APEX_cpu_step(cpu, cycles < 0 ? LONG_MAX : cycles);
+            break;
+        }
+
+        if (debug)
+        {
+            fprintf(cpu->out, "--------------------------------------------\n");
+            fprintf(cpu->out, "%s: %d\n", label, cpu->clock + 1);
+            fprintf(cpu->out, "--------------------------------------------\n");
+        }
+        status = APEX_cpu_step(cpu, 1);
+        if (cycles > 0)
+        {
+            cycles--;
+        }
+        if (status != APEX_STATUS_RUNNING)
+        {
+            break;
+        }
+        if (debug)
+        {
+            print_cpu_state(cpu);
+        }
+
+        if (prompt)
+        {
+            fprintf(cpu->out, "Press any key to advance CPU Clock or <q> to quit:\n");
+            scanf("%c", &user_prompt_val);
+
+            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
+            {
+                fprintf(cpu->out, "APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                return status;
+            }
+        }
+    }
+
+    if (status == APEX_STATUS_FAULT)
+    {
+        fprintf(cpu->diag, "APEX_Error: Memory fault at pc(%d), address %d outside data memory of %ld words\n",
+                cpu->mem_fault_pc, cpu->mem_fault_address, cpu->config.memory_size);
+    }
+    if (status == APEX_STATUS_FETCH_FAULT)
+    {
+        fprintf(cpu->diag, "APEX_Error: Fetch fault at pc(%d) outside code memory of %d instructions\n",
+                cpu->fetch_fault_pc, cpu->code_memory_size);
+    }
+    if (status == APEX_STATUS_HALTED)
+    {
+        fprintf(cpu->out, "APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
+    }
+    return status;
+}
+
+/*
+ * APEX CPU simulation loop
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+void APEX_cpu_run(APEX_CPU *cpu)
+{
+    drive(cpu, -1, cpu->single_step, "Clock Cycle #");
+}
+void APEX_cpu_simulate(APEX_CPU *cpu, int cycles)
+{
+    drive(cpu, cycles, FALSE, "Clock Cycle");
+}
+void APEX_cpu_display(APEX_CPU *cpu)
+{
+    drive(cpu, -1, FALSE, "Clock Cycle");
+}
+void APEX_cpu_show_mem(APEX_CPU *cpu, int mem_loc)
+{
+    int value;
+
+    drive(cpu, -1, FALSE, "Clock Cycle");
+    if (APEX_mem_read(cpu, mem_loc, &value) != 0)
+    {
+        fprintf(cpu->diag, "APEX_Error: MEM[%d] is outside data memory of %ld words\n", mem_loc, cpu->config.memory_size);
+        return;
+    }
+    fprintf(cpu->out, "\nValue at Memory Location is MEM[%d]  = %d\n", mem_loc, value);
+}
+
+/*
+ * Runs the program to HALT without any per-cycle output and prints a
+ * summary of the run: cycles, retired instructions, CPI, the final
+ * architectural state and the host simulation speed.
+ */
+void APEX_cpu_batch(APEX_CPU *cpu)
+{
+    struct timespec start, end;
+    double host_seconds;
+    int cycles;
+    int i;
+
+    cpu->debug_messages = FALSE;
+    cpu->single_step = FALSE;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    drive(cpu, -1, FALSE, "Clock Cycle");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    cycles = cpu->clock + 1;
+    host_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(cpu->out, "CPI = %.3f\n", cpu->insn_completed ? (double)cycles / cpu->insn_completed : 0.0);
+    if (cpu->insn_fast_forwarded)
+    {
+        fprintf(cpu->out, "Fast-forwarded instructions = %ld\n", cpu->insn_fast_forwarded);
+    }
+    if (cpu->config.predictor != PREDICTOR_NONE && cpu->counters.branches)
+    {
+        fprintf(cpu->out, "Branch prediction accuracy = %.2f%% (%ld of %ld mispredicted)\n",
+                100.0 * (cpu->counters.branches - cpu->counters.mispredicts) / cpu->counters.branches,
+                cpu->counters.mispredicts, cpu->counters.branches);
+    }
+    fprintf(cpu->out, "Functional unit utilization:");
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        fprintf(cpu->out, " %s = %.2f%%", apex_fu_names[i],
+                cycles ? 100.0 * cpu->counters.fu_busy[i] / cycles : 0.0);
+    }
+    fprintf(cpu->out, "\n");
+    if (cpu->config.width > 1 || cpu->config.core == CORE_OOO)
+    {
+        long idle = cycles;
+
+        /* Cycles decode issued nothing are the remainder */
+        for (i = 1; i <= cpu->config.width; ++i)
+        {
+            idle -= cpu->counters.issued[i];
+        }
+        fprintf(cpu->out, "Instructions issued per cycle: 0 = %.2f%%", cycles ? 100.0 * idle / cycles : 0.0);
+        for (i = 1; i <= cpu->config.width; ++i)
+        {
+            fprintf(cpu->out, " %d = %.2f%%", i, cycles ? 100.0 * cpu->counters.issued[i] / cycles : 0.0);
+        }
+        fprintf(cpu->out, ", IPC = %.3f\n", cycles ? (double)cpu->insn_completed / cycles : 0.0);
+    }
+    if (cpu->config.core == CORE_OOO && cycles)
+    {
+        fprintf(cpu->out, "Average occupancy: ROB = %.2f IQ = %.2f LSQ = %.2f, loads forwarded = %ld\n",
+                (double)cpu->counters.rob_entries / cycles, (double)cpu->counters.iq_entries / cycles,
+                (double)cpu->counters.lsq_entries / cycles, cpu->counters.store_forwards);
+    }
+    if (cpu->icache.accesses)
+    {
+        fprintf(cpu->out, "I-cache: accesses = %ld hits = %ld misses = %ld hit rate = %.2f%%\n",
+                cpu->icache.accesses, cpu->icache.hits, cpu->icache.misses,
+                100.0 * cpu->icache.hits / cpu->icache.accesses);
+    }
+    if (cpu->dcache.accesses)
+    {
+        fprintf(cpu->out, "D-cache: accesses = %ld hits = %ld misses = %ld hit rate = %.2f%%\n",
+                cpu->dcache.accesses, cpu->dcache.hits, cpu->dcache.misses,
+                100.0 * cpu->dcache.hits / cpu->dcache.accesses);
+    }
+    cpu->mem_changes_only = FALSE;
+    print_cpu_state(cpu);
+    fprintf(cpu->out, "-------\n%s\n-------\n", "Host:");
+    fprintf(cpu->out, "Wall clock = %.6f s\n", host_seconds);
+    fprintf(cpu->out, "Simulated cycles/s = %.0f\n", host_seconds > 0 ? cycles / host_seconds : 0.0);
+}
+
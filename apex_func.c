@@ -0,0 +1,125 @@
+/*
+ * apex_func.c
+ * Contains the functional (ISA-only) model of APEX, used to fast-forward
+ * through a program before switching to the detailed pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/*
+ * Executes up to count instructions architecturally, one instruction per
+ * step with no pipeline timing, over the same registers, flags and data
+ * memory as the detailed model. Stops early in front of HALT so that the
+ * pipeline retires it.
+ *
+ * On return the pipeline latches and hazard state are empty and the fetch
+ * stage restarts from the current PC, so the detailed model can be run from
+ * here. The clock is not advanced.
+ *
+ * Returns the number of instructions executed.
+ */
+long
+APEX_cpu_fast_forward(APEX_CPU *cpu, long count)
+{
+    CPU_Stage stage;
+    long executed = 0;
+
+    memset(&stage, 0, sizeof(stage));
+
+    while (executed < count)
+    {
+        int index = APEX_code_index(cpu, cpu->pc);
+        const APEX_Instruction *ins;
+        const APEX_OpInfo *op;
+
+        if (index < 0)
+        {
+            /* Leave the fetch fault to the pipeline, which reports it */
+            break;
+        }
+
+        ins = &cpu->code_memory[index];
+        if (ins->opcode == OPCODE_HALT)
+        {
+            break;
+        }
+        op = &apex_op_table[ins->opcode];
+
+        stage.pc = cpu->pc;
+        stage.insn = ins;
+        stage.rs1_value = cpu->regs[ins->rs1];
+        stage.rs2_value = cpu->regs[ins->rs2];
+
+        if (op->exec)
+        {
+            op->exec(&stage);
+        }
+        if (op->mem != MEM_NONE && !APEX_mem_in_range(cpu, stage.memory_address))
+        {
+            /* Leave the faulting access to the pipeline, which reports it */
+            break;
+        }
+        if (op->flags)
+        {
+            APEX_update_flags(cpu, op->flags, stage.result_buffer);
+        }
+
+        if (op->mem == MEM_LOAD)
+        {
+            APEX_mem_read(cpu, stage.memory_address, &stage.result_buffer);
+        }
+        else if (op->mem == MEM_STORE)
+        {
+            APEX_mem_write(cpu, stage.memory_address, stage.rs1_value);
+        }
+
+        /* Same write order as writeback */
+        if (op->dst & DST_RD)
+        {
+            cpu->regs[ins->rd] = stage.result_buffer;
+        }
+        if (op->dst & DST_RS1_POST)
+        {
+            cpu->regs[ins->rs1] = stage.rs1_value + 4;
+        }
+        if (op->dst & DST_RS2_POST)
+        {
+            cpu->regs[ins->rs2] = stage.rs2_value + 4;
+        }
+
+        if (op->ctrl != CTRL_NONE && APEX_branch_taken(cpu, op))
+        {
+            cpu->pc = (op->ctrl == CTRL_REG ? stage.rs1_value : stage.pc) + ins->imm;
+        }
+        else
+        {
+            cpu->pc += 4;
+        }
+        executed++;
+    }
+
+    /* Hand over to the detailed model with an empty pipeline */
+    memset(&cpu->fetch, 0, sizeof(CPU_Stage));
+    memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    memset(&cpu->execute, 0, sizeof(CPU_Stage));
+    memset(&cpu->memory, 0, sizeof(CPU_Stage));
+    memset(&cpu->writeback, 0, sizeof(CPU_Stage));
+    memset(cpu->reg_producer, 0, sizeof(cpu->reg_producer));
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->fetch_cycles_left = 0;
+    memset(cpu->fu_queue, 0, sizeof(cpu->fu_queue));
+    memset(cpu->fu_free_cycle, 0, sizeof(cpu->fu_free_cycle));
+    cpu->fu_queue_count = 0;
+    memset(cpu->wide, 0, sizeof(cpu->wide));
+    memset(&cpu->ooo, 0, sizeof(cpu->ooo));
+    cpu->fetch.has_insn = TRUE;
+
+    cpu->insn_fast_forwarded += executed;
+    return executed;
+}
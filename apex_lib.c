@@ -0,0 +1,327 @@
+/*
+ * apex_lib.c
+ * Contains libapex, the simulator API declared in apex.h. Every cpu is
+ * created silent: no debug messages, no prompts, no output of any kind.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex.h"
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Reports an error into the caller's buffer, which may be NULL */
+static void
+set_error(char *error, size_t error_size, const char *fmt, ...)
+{
+    va_list args;
+
+    if (error && error_size)
+    {
+        va_start(args, fmt);
+        vsnprintf(error, error_size, fmt, args);
+        va_end(args);
+    }
+}
+
+/* Sink for the diagnostics of the assembler, written into the caller's
+ * buffer. Returns NULL when there is nowhere to write them. */
+static FILE *
+open_diag(char *error, size_t error_size)
+{
+    if (!error || !error_size)
+    {
+        return NULL;
+    }
+    error[0] = '\0';
+    return fmemopen(error, error_size, "w");
+}
+
+static void
+close_diag(FILE *diag, char *error, size_t error_size)
+{
+    size_t len;
+
+    if (!diag)
+    {
+        return;
+    }
+    fclose(diag);
+    error[error_size - 1] = '\0';
+
+    /* Keep the first diagnostic, without its line ending */
+    len = strcspn(error, "\n");
+    error[len] = '\0';
+}
+
+/* Applies "name=value" options separated by ';' or whitespace */
+static int
+apply_options(APEX_Config *config, const char *options, char *error, size_t error_size)
+{
+    char *copy, *option, *save;
+    int ret = 0;
+
+    if (!options)
+    {
+        return 0;
+    }
+    copy = strdup(options);
+    if (!copy)
+    {
+        set_error(error, error_size, "Unable to allocate the options");
+        return -1;
+    }
+    for (option = strtok_r(copy, "; \t\n", &save); option; option = strtok_r(NULL, "; \t\n", &save))
+    {
+        char *value = strchr(option, '=');
+
+        if (!value)
+        {
+            set_error(error, error_size, "Expected <name>=<value>, got %s", option);
+            ret = -1;
+            break;
+        }
+        *value++ = '\0';
+        if (APEX_config_set(config, option, value) != 0)
+        {
+            set_error(error, error_size, "Invalid configuration %s", option);
+            ret = -1;
+            break;
+        }
+    }
+    free(copy);
+    return ret;
+}
+
+/* Allocates a silent cpu configured by options, without code memory */
+static APEX_CPU *
+create_cpu(const char *options, char *error, size_t error_size)
+{
+    APEX_CPU *cpu = APEX_cpu_alloc();
+
+    if (!cpu)
+    {
+        set_error(error, error_size, "Unable to allocate the cpu");
+        return NULL;
+    }
+    cpu->debug_messages = FALSE;
+    cpu->single_step = FALSE;
+    cpu->out = NULL;
+    cpu->diag = NULL;
+
+    if (apply_options(&cpu->config, options, error, error_size) != 0)
+    {
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    if (!APEX_cache_config_valid(&cpu->config.icache))
+    {
+        set_error(error, error_size, "Invalid instruction cache geometry");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    if (!APEX_cache_config_valid(&cpu->config.dcache))
+    {
+        set_error(error, error_size, "Invalid data cache geometry");
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    return cpu;
+}
+
+APEX_CPU *
+apex_create(const char *filename, const char *options, char *error, size_t error_size)
+{
+    APEX_CPU *cpu;
+    FILE *diag;
+
+    if (!filename)
+    {
+        set_error(error, error_size, "No program file");
+        return NULL;
+    }
+    cpu = create_cpu(options, error, error_size);
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    diag = open_diag(error, error_size);
+    cpu->code_memory = load_code_memory(filename, &cpu->code_memory_size,
+                                        &cpu->code_memory_map, &cpu->code_memory_map_size,
+                                        diag);
+    close_diag(diag, error, error_size);
+    if (!cpu->code_memory)
+    {
+        if (error && error_size && !error[0])
+        {
+            set_error(error, error_size, "Unable to load %s", filename);
+        }
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    return cpu;
+}
+
+APEX_CPU *
+apex_create_from_buffer(const char *buffer, size_t length, const char *options,
+                        char *error, size_t error_size)
+{
+    APEX_CPU *cpu;
+    FILE *diag;
+
+    if (!buffer)
+    {
+        set_error(error, error_size, "No program text");
+        return NULL;
+    }
+    cpu = create_cpu(options, error, error_size);
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    diag = open_diag(error, error_size);
+    cpu->code_memory = parse_code_memory(buffer, length, "<buffer>", &cpu->code_memory_size, diag);
+    close_diag(diag, error, error_size);
+    if (!cpu->code_memory)
+    {
+        if (error && error_size && !error[0])
+        {
+            set_error(error, error_size, "No instructions in the program text");
+        }
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    return cpu;
+}
+
+int
+apex_step(APEX_CPU *cpu, long cycles)
+{
+    return APEX_cpu_step(cpu, cycles);
+}
+
+int
+apex_run_until(APEX_CPU *cpu, apex_predicate predicate, void *arg)
+{
+    while (APEX_cpu_advance(cpu, LONG_MAX) == APEX_STATUS_RUNNING)
+    {
+        if (predicate && predicate(cpu, arg))
+        {
+            break;
+        }
+    }
+    return cpu->status;
+}
+
+int
+apex_status(const APEX_CPU *cpu)
+{
+    return cpu->status;
+}
+
+long
+apex_cycles(const APEX_CPU *cpu)
+{
+    return cpu->counters.cycles;
+}
+
+long
+apex_instructions(const APEX_CPU *cpu)
+{
+    return cpu->counters.retired;
+}
+
+int
+apex_pc(const APEX_CPU *cpu)
+{
+    return cpu->pc;
+}
+
+int
+apex_register(const APEX_CPU *cpu, int reg, int *value)
+{
+    if (reg < 0 || reg >= REG_FILE_SIZE)
+    {
+        return -1;
+    }
+    *value = cpu->regs[reg];
+    return 0;
+}
+
+int
+apex_flags(const APEX_CPU *cpu)
+{
+    return (cpu->zero_flag ? APEX_FLAG_ZERO : 0) | (cpu->positive_flag ? APEX_FLAG_POSITIVE : 0) |
+           (cpu->negative_flag ? APEX_FLAG_NEGATIVE : 0);
+}
+
+int
+apex_memory(APEX_CPU *cpu, int address, int *value)
+{
+    /* Checked here, an access outside data memory would record a fault */
+    if (!APEX_mem_in_range(cpu, address))
+    {
+        return -1;
+    }
+    return APEX_mem_read(cpu, address, value);
+}
+
+int
+apex_fault(const APEX_CPU *cpu, int *pc, int *address)
+{
+    if (cpu->status == APEX_STATUS_FETCH_FAULT)
+    {
+        *pc = cpu->fetch_fault_pc;
+        *address = cpu->fetch_fault_pc;
+        return 0;
+    }
+    if (cpu->status != APEX_STATUS_FAULT)
+    {
+        return -1;
+    }
+    *pc = cpu->mem_fault_pc;
+    *address = cpu->mem_fault_address;
+    return 0;
+}
+
+int
+apex_observe(APEX_CPU *cpu, unsigned int events, apex_observer fn, void *arg)
+{
+    return APEX_cpu_observe(cpu, events, fn, arg);
+}
+
+void
+apex_unobserve(APEX_CPU *cpu, int handle)
+{
+    APEX_cpu_unobserve(cpu, handle);
+}
+
+const char *
+apex_stage_name(int stage)
+{
+    return stage >= 0 && stage < NUM_STAGES ? apex_stage_names[stage] : NULL;
+}
+
+const char *
+apex_stall_cause_name(int cause)
+{
+    return cause >= 0 && cause < NUM_STALL_CAUSES ? apex_stall_cause_names[cause] : NULL;
+}
+
+void
+apex_destroy(APEX_CPU *cpu)
+{
+    if (cpu)
+    {
+        APEX_cpu_stop(cpu);
+    }
+}
@@ -12,9 +12,48 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
-/* Integers */
+/* Default data memory size in integers, configurable up to
+ * MAX_DATA_MEMORY_SIZE */
 #define DATA_MEMORY_SIZE 4096
 
+/* Sparse data memory: 2^11 directory entries of 2^10 tables of 2^10 word
+ * pages cover the full non-negative int address space */
+#define MEM_PAGE_BITS 10
+#define MEM_PAGE_WORDS (1 << MEM_PAGE_BITS)
+#define MEM_TABLE_BITS 10
+#define MEM_TABLE_ENTRIES (1 << MEM_TABLE_BITS)
+#define MEM_DIR_ENTRIES (1 << (31 - MEM_PAGE_BITS - MEM_TABLE_BITS))
+#define MAX_DATA_MEMORY_SIZE (1L << 31)
+
+/* Data memory writes tracked per cycle for the changed-words display, at
+ * most one store per slot of the widest core retires in a cycle */
+#define MAX_MEM_CHANGES_PER_CYCLE MAX_WIDTH
+
+/* Largest branch target buffer and 2-bit counter table */
+#define MAX_BTB_ENTRIES 1024
+#define MAX_BP_ENTRIES 4096
+
+/* Pipeline trace records buffered before each write */
+#define TRACE_BUFFER_RECORDS 16384
+
+/* Operations in flight in the Execute functional units */
+#define MAX_FU_IN_FLIGHT 8
+
+/* Widest superscalar pipeline, instructions per stage per cycle */
+#define MAX_WIDTH 4
+
+/* Largest structures of the out-of-order core */
+#define MAX_ROB_SIZE 128
+#define MAX_IQ_SIZE 64
+#define MAX_LSQ_SIZE 64
+#define MAX_PHYS_REGS 256
+
+/* Profile counts one cycle may increment and still be skipped over */
+#define MAX_SKIP_PROFILE 16
+
+/* Observers registered on one cpu at a time */
+#define MAX_OBSERVERS 8
+
 /* Size of integer register file */
 #define REG_FILE_SIZE 32
 
@@ -46,6 +85,9 @@
 #define OPCODE_JALR 0x18
 #define OPCODE_NOP 0x1a
 
+/* Number of entries in the opcode handler table */
+#define NUM_OPCODES 0x1b
+
 
 
 
@@ -55,4 +97,7 @@
 /* Set this flag to 1 to enable cycle single-step mode */
 #define ENABLE_SINGLE_STEP 1
 
+/* Set this flag to 0 to compile every observer hook out of the core */
+#define ENABLE_OBSERVERS 1
+
 #endif
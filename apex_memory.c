@@ -0,0 +1,331 @@
+/*
+ * apex_memory.c
+ * Contains the APEX data memory: a sparse two-level page table whose pages
+ * are allocated from an arena on first write, so that a large address
+ * space only costs host memory for the pages a program touches. Every
+ * access goes through APEX_mem_read / APEX_mem_write, which check the
+ * address against the configured memory size. Writes are tracked so that
+ * displays and dumps only visit the words that were ever written.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Pages handed out per arena chunk */
+#define MEM_ARENA_PAGES 16
+
+struct APEX_MemTable
+{
+    int *pages[MEM_TABLE_ENTRIES];
+};
+
+/* A page and the words of it that were ever written. Pages are handed out
+ * as their words, which come first. */
+typedef struct APEX_MemPage
+{
+    int words[MEM_PAGE_WORDS];
+    uint64_t written[MEM_PAGE_WORDS / 64];
+} APEX_MemPage;
+
+struct APEX_MemChunk
+{
+    struct APEX_MemChunk *next;
+    int used;
+    APEX_MemPage pages[MEM_ARENA_PAGES];
+};
+
+/* Returns the page holding page_number, or NULL if it was never written */
+static int *
+find_page(APEX_DataMemory *mem, long page_number)
+{
+    APEX_MemTable *table;
+
+    if (mem->last_page && page_number == mem->last_page_number)
+    {
+        return mem->last_page;
+    }
+
+    table = mem->directory[page_number >> MEM_TABLE_BITS];
+    if (!table || !table->pages[page_number & (MEM_TABLE_ENTRIES - 1)])
+    {
+        return NULL;
+    }
+    mem->last_page_number = page_number;
+    mem->last_page = table->pages[page_number & (MEM_TABLE_ENTRIES - 1)];
+    return mem->last_page;
+}
+
+/* Returns the page holding page_number, allocating a zeroed page from the
+ * arena on first use. Returns NULL if host memory is exhausted. */
+static int *
+get_page(APEX_DataMemory *mem, long page_number)
+{
+    APEX_MemTable **table = &mem->directory[page_number >> MEM_TABLE_BITS];
+    int **page;
+
+    if (mem->last_page && page_number == mem->last_page_number)
+    {
+        return mem->last_page;
+    }
+
+    if (!*table)
+    {
+        *table = calloc(1, sizeof(APEX_MemTable));
+        if (!*table)
+        {
+            return NULL;
+        }
+    }
+
+    page = &(*table)->pages[page_number & (MEM_TABLE_ENTRIES - 1)];
+    if (!*page)
+    {
+        if (!mem->arena || mem->arena->used == MEM_ARENA_PAGES)
+        {
+            APEX_MemChunk *chunk = calloc(1, sizeof(APEX_MemChunk));
+
+            if (!chunk)
+            {
+                return NULL;
+            }
+            chunk->next = mem->arena;
+            mem->arena = chunk;
+        }
+        *page = mem->arena->pages[mem->arena->used++].words;
+        mem->num_pages++;
+    }
+
+    mem->last_page_number = page_number;
+    mem->last_page = *page;
+    return *page;
+}
+
+/*
+ * Adds address, a word of page, to the written words the first time it is
+ * written.
+ *
+ * Returns 0 on success, -1 if host memory is exhausted.
+ */
+static int
+mark_touched(APEX_DataMemory *mem, int *page, int address)
+{
+    uint64_t *written = ((APEX_MemPage *)page)->written;
+    int offset = address & (MEM_PAGE_WORDS - 1);
+
+    if (written[offset / 64] & (1ULL << (offset % 64)))
+    {
+        return 0;
+    }
+    if (mem->num_touched == mem->touched_capacity)
+    {
+        long capacity = mem->touched_capacity ? 2 * mem->touched_capacity : MEM_PAGE_WORDS;
+        int *touched = realloc(mem->touched, capacity * sizeof(int));
+
+        if (!touched)
+        {
+            return -1;
+        }
+        mem->touched = touched;
+        mem->touched_capacity = capacity;
+    }
+    written[offset / 64] |= 1ULL << (offset % 64);
+
+    /* Programs mostly write upwards, the list is only sorted when read */
+    if (mem->num_touched && mem->touched[mem->num_touched - 1] > address)
+    {
+        mem->touched_unsorted = TRUE;
+    }
+    mem->touched[mem->num_touched++] = address;
+    return 0;
+}
+
+/* Records a fault at address, reported by the stage that made the access */
+static int
+memory_fault(APEX_CPU *cpu, int address)
+{
+    cpu->mem_fault = TRUE;
+    cpu->mem_fault_address = address;
+    return -1;
+}
+
+/* Returns TRUE if address lies inside the configured data memory */
+int
+APEX_mem_in_range(const APEX_CPU *cpu, int address)
+{
+    return address >= 0 && address < cpu->config.memory_size;
+}
+
+/*
+ * Reads the word at address into value, words never written read as zero.
+ *
+ * Returns 0 on success, -1 on a fault.
+ */
+int
+APEX_mem_read(APEX_CPU *cpu, int address, int *value)
+{
+    int *page;
+
+    if (!APEX_mem_in_range(cpu, address))
+    {
+        return memory_fault(cpu, address);
+    }
+
+    page = find_page(&cpu->data_memory, address >> MEM_PAGE_BITS);
+    *value = page ? page[address & (MEM_PAGE_WORDS - 1)] : 0;
+    return 0;
+}
+
+/*
+ * Writes value to the word at address.
+ *
+ * Returns 0 on success, -1 on a fault.
+ */
+int
+APEX_mem_write(APEX_CPU *cpu, int address, int value)
+{
+    int *page;
+
+    if (!APEX_mem_in_range(cpu, address))
+    {
+        return memory_fault(cpu, address);
+    }
+
+    page = get_page(&cpu->data_memory, address >> MEM_PAGE_BITS);
+    if (!page || mark_touched(&cpu->data_memory, page, address) != 0)
+    {
+        return memory_fault(cpu, address);
+    }
+    page[address & (MEM_PAGE_WORDS - 1)] = value;
+
+    if (cpu->num_changed < MAX_MEM_CHANGES_PER_CYCLE)
+    {
+        cpu->data_memory_changed[cpu->num_changed] = address;
+    }
+    cpu->num_changed++;
+    return 0;
+}
+
+/* Starts a new cycle of change tracking */
+void
+APEX_mem_begin_cycle(APEX_CPU *cpu)
+{
+    cpu->num_changed = 0;
+}
+
+/*
+ * Returns the first allocated page at or after *page_number and stores its
+ * number back in *page_number, or NULL once all pages were visited. Used to
+ * walk data memory in address order.
+ */
+const int *
+APEX_mem_next_page(const APEX_CPU *cpu, long *page_number)
+{
+    const APEX_DataMemory *mem = &cpu->data_memory;
+    long number;
+
+    for (number = *page_number; number < MEM_DIR_ENTRIES * MEM_TABLE_ENTRIES;)
+    {
+        const APEX_MemTable *table = mem->directory[number >> MEM_TABLE_BITS];
+
+        if (!table)
+        {
+            number = ((number >> MEM_TABLE_BITS) + 1) << MEM_TABLE_BITS;
+            continue;
+        }
+        if (table->pages[number & (MEM_TABLE_ENTRIES - 1)])
+        {
+            *page_number = number;
+            return table->pages[number & (MEM_TABLE_ENTRIES - 1)];
+        }
+        number++;
+    }
+    return NULL;
+}
+
+static int
+compare_addresses(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Returns the addresses of the words ever written, in address order, and
+ * stores their number in *count. Only these words can be non-zero.
+ */
+const int *
+APEX_mem_touched(APEX_CPU *cpu, long *count)
+{
+    APEX_DataMemory *mem = &cpu->data_memory;
+
+    if (mem->touched_unsorted)
+    {
+        qsort(mem->touched, mem->num_touched, sizeof(int), compare_addresses);
+        mem->touched_unsorted = FALSE;
+    }
+    *count = mem->num_touched;
+    return mem->touched;
+}
+
+/*
+ * Copies a whole page into data memory, used by checkpoint restore. Its
+ * non-zero words count as written.
+ *
+ * Returns 0 on success, -1 if page_number is invalid or host memory is
+ * exhausted.
+ */
+int
+APEX_mem_load_page(APEX_CPU *cpu, long page_number, const int *words)
+{
+    int *page;
+    int i;
+
+    if (page_number < 0 || page_number >= MEM_DIR_ENTRIES * MEM_TABLE_ENTRIES)
+    {
+        return -1;
+    }
+    page = get_page(&cpu->data_memory, page_number);
+    if (!page)
+    {
+        return -1;
+    }
+    memcpy(page, words, MEM_PAGE_WORDS * sizeof(int));
+    for (i = 0; i < MEM_PAGE_WORDS; ++i)
+    {
+        if (words[i] != 0 &&
+            mark_touched(&cpu->data_memory, page, (int)((page_number << MEM_PAGE_BITS) + i)) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Releases all pages and tables, leaving an empty data memory */
+void
+APEX_mem_release(APEX_CPU *cpu)
+{
+    APEX_DataMemory *mem = &cpu->data_memory;
+    int i;
+
+    for (i = 0; i < MEM_DIR_ENTRIES; ++i)
+    {
+        free(mem->directory[i]);
+    }
+    while (mem->arena)
+    {
+        APEX_MemChunk *next = mem->arena->next;
+
+        free(mem->arena);
+        mem->arena = next;
+    }
+    free(mem->touched);
+    memset(mem, 0, sizeof(*mem));
+}
@@ -0,0 +1,635 @@
+/*
+ * apex_ooo.c
+ * Contains the out-of-order APEX core, selected with config.core CORE_OOO
+ *
+ * Fetch is the superscalar one of apex_wide.c. Rename maps the architectural
+ * registers and the condition flags onto a physical register file and
+ * places every instruction in the reorder buffer, the unified issue queue
+ * and, for a LOAD or STORE, the load/store queue. Each cycle the oldest
+ * instructions whose operands are ready issue to their functional units, a
+ * result waking up its readers the cycle after it is computed. Loads access
+ * data memory once the addresses of all older stores are known, taking the
+ * data of a matching older store instead. Instructions retire in order to
+ * regs[], stores writing data memory as they retire.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Rename map index of the condition flags */
+#define FLAGS_REG REG_FILE_SIZE
+
+/* Ready cycle of a physical register whose writer has not issued */
+#define NOT_READY INT_MAX
+
+/* Returns the reorder buffer index of the nth oldest instruction */
+static int
+rob_index(const APEX_CPU *cpu, int n)
+{
+    return (cpu->ooo.rob_head + n) % cpu->config.rob_size;
+}
+
+/* Maps every architectural register and the flags to a physical register
+ * holding its current value, the others are free */
+static void
+ooo_start(APEX_CPU *cpu)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    int i;
+
+    memset(ooo, 0, sizeof(APEX_OutOfOrder));
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        ooo->rename_map[i] = i;
+        ooo->phys_value[i] = cpu->regs[i];
+    }
+    ooo->rename_map[FLAGS_REG] = FLAGS_REG;
+    ooo->phys_value[FLAGS_REG] = (cpu->zero_flag ? FLAG_Z : 0) |
+                                 (cpu->positive_flag ? FLAG_P : 0) |
+                                 (cpu->negative_flag ? FLAG_N : 0);
+    for (i = cpu->config.phys_regs - 1; i > FLAGS_REG; --i)
+    {
+        ooo->free_list[ooo->free_count++] = i;
+    }
+    ooo->active = TRUE;
+}
+
+/* Charges the cycle about to be simulated to the oldest instruction in the
+ * core, or to the fetch PC when it is empty */
+static void
+profile_cycle(APEX_CPU *cpu)
+{
+    APEX_PcProfile *entry = NULL;
+
+    if (cpu->ooo.rob_count)
+    {
+        entry = APEX_profile_entry(cpu, cpu->ooo.rob[cpu->ooo.rob_head].stage.pc);
+    }
+    else if (cpu->wide[STAGE_DECODE].count)
+    {
+        entry = APEX_profile_entry(cpu, cpu->wide[STAGE_DECODE].slot[0].pc);
+    }
+    else if (cpu->wide[STAGE_FETCH].count)
+    {
+        entry = APEX_profile_entry(cpu, cpu->wide[STAGE_FETCH].slot[0].pc);
+    }
+    else if (cpu->fetch.has_insn)
+    {
+        entry = APEX_profile_entry(cpu, cpu->pc);
+    }
+    if (entry)
+    {
+        APEX_profile_count(cpu, &entry->cycles);
+    }
+}
+
+/* Squashes every instruction younger than branch, restoring the rename map
+ * from the youngest back, and redirects fetch to target */
+static void
+squash_after(APEX_CPU *cpu, const CPU_Stage *branch, int target)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    APEX_PcProfile *entry = APEX_profile_entry(cpu, branch->pc);
+    int squashed = cpu->wide[STAGE_DECODE].count + cpu->wide[STAGE_FETCH].count;
+    int k;
+
+    while (ooo->rob_count)
+    {
+        APEX_RobEntry *young = &ooo->rob[rob_index(cpu, ooo->rob_count - 1)];
+
+        if (young->stage.seq <= branch->seq)
+        {
+            break;
+        }
+        for (k = 2; k >= 0; --k)
+        {
+            if (young->dst[k] >= 0)
+            {
+                ooo->rename_map[young->arch_dst[k]] = young->old_dst[k];
+                ooo->free_list[ooo->free_count++] = young->dst[k];
+            }
+        }
+        ooo->rob_count--;
+        squashed++;
+    }
+
+    /* Both queues are in program order */
+    while (ooo->iq_count && ooo->rob[ooo->iq[ooo->iq_count - 1]].stage.seq > branch->seq)
+    {
+        ooo->iq_count--;
+    }
+    while (ooo->lsq_count && ooo->rob[ooo->lsq[ooo->lsq_count - 1]].stage.seq > branch->seq)
+    {
+        ooo->lsq_count--;
+    }
+
+    cpu->counters.flushed += squashed;
+    if (entry)
+    {
+        /* The squashed instructions and the skipped fetch */
+        entry->flushes += squashed + 1;
+    }
+    if (cpu->trace)
+    {
+        APEX_trace_event(cpu, STAGE_EXECUTE, TRACE_FLUSH, branch, squashed);
+    }
+    APEX_OBSERVE(cpu, APEX_EVENT_FLUSH, STAGE_EXECUTE, branch, squashed, target, 0);
+
+    cpu->pc = target;
+    cpu->fetch_from_next_cycle = TRUE;
+    cpu->wide[STAGE_DECODE].count = 0;
+    cpu->wide[STAGE_FETCH].count = 0;
+    cpu->fetch_cycles_left = 0;
+    cpu->fetch.has_insn = TRUE;
+}
+
+/* Maps destination k of entry, architectural register arch or -1 for none,
+ * to a free physical register */
+static void
+rename_destination(APEX_CPU *cpu, APEX_RobEntry *entry, int k, int arch)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    int phys;
+
+    entry->dst[k] = -1;
+    if (arch < 0)
+    {
+        return;
+    }
+    phys = ooo->free_list[--ooo->free_count];
+    ooo->phys_ready_cycle[phys] = NOT_READY;
+    entry->dst[k] = phys;
+    entry->arch_dst[k] = arch;
+    entry->old_dst[k] = ooo->rename_map[arch];
+    ooo->rename_map[arch] = phys;
+}
+
+/*
+ * Rename Stage of the out-of-order core
+ *
+ * Moves decoded instructions in order into the reorder buffer and the
+ * queues, until one of them or the free list runs out.
+ */
+static void
+ooo_rename(APEX_CPU *cpu)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    APEX_StageGroup *decode = &cpu->wide[STAGE_DECODE];
+    int n, i;
+
+    for (n = 0; n < decode->count; ++n)
+    {
+        const CPU_Stage *stage = &decode->slot[n];
+        const APEX_Instruction *ins = stage->insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+        int post = (op->dst & DST_RS1_POST) ? ins->rs1 : (op->dst & DST_RS2_POST) ? ins->rs2 : -1;
+        int needed = ((op->dst & DST_RD) != 0) + (post >= 0) + (op->flags != 0);
+        APEX_RobEntry *entry;
+        int cause = -1;
+
+        if (ooo->rob_count == cpu->config.rob_size)
+        {
+            cause = STALL_ROB_FULL;
+        }
+        else if (ooo->iq_count == cpu->config.iq_size)
+        {
+            cause = STALL_IQ_FULL;
+        }
+        else if (op->mem != MEM_NONE && ooo->lsq_count == cpu->config.lsq_size)
+        {
+            cause = STALL_LSQ_FULL;
+        }
+        else if (ooo->free_count < needed)
+        {
+            cause = STALL_FREE_LIST;
+        }
+        if (cause >= 0)
+        {
+            APEX_count_stall(cpu, cause, STAGE_DECODE, stage);
+            break;
+        }
+
+        entry = &ooo->rob[rob_index(cpu, ooo->rob_count)];
+        entry->stage = *stage;
+        entry->issued = FALSE;
+        entry->mem_pending = FALSE;
+        entry->fault = FALSE;
+
+        /* Sources are looked up before the destinations are renamed, LOADP
+         * reads and writes rs1. A partial flags update merges into the
+         * current flags. */
+        entry->src[0] = (op->src & SRC_RS1) ? ooo->rename_map[ins->rs1] : -1;
+        entry->src[1] = (op->src & SRC_RS2) ? ooo->rename_map[ins->rs2] : -1;
+        entry->src[2] = op->cond_flags || (op->flags && op->flags != FLAG_ALL)
+                            ? ooo->rename_map[FLAGS_REG]
+                            : -1;
+        rename_destination(cpu, entry, 0, (op->dst & DST_RD) ? ins->rd : -1);
+        rename_destination(cpu, entry, 1, post);
+        rename_destination(cpu, entry, 2, op->flags ? FLAGS_REG : -1);
+
+        ooo->iq[ooo->iq_count++] = rob_index(cpu, ooo->rob_count);
+        if (op->mem != MEM_NONE)
+        {
+            ooo->lsq[ooo->lsq_count++] = rob_index(cpu, ooo->rob_count);
+        }
+        ooo->rob_count++;
+    }
+
+    for (i = 0; i < decode->count; ++i)
+    {
+        APEX_stage_event(cpu, STAGE_DECODE, &decode->slot[i]);
+    }
+    decode->count -= n;
+    memmove(&decode->slot[0], &decode->slot[n], decode->count * sizeof(CPU_Stage));
+}
+
+/* Returns TRUE if every physical register entry reads holds its value */
+static int
+operands_ready(const APEX_CPU *cpu, const APEX_RobEntry *entry)
+{
+    int k;
+
+    for (k = 0; k < 3; ++k)
+    {
+        if (entry->src[k] >= 0 && cpu->ooo.phys_ready_cycle[entry->src[k]] > cpu->clock)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Reads a source operand, counting it as bypassed when its producer woke
+ * the instruction up this cycle */
+static int
+read_operand(APEX_CPU *cpu, int phys)
+{
+    cpu->counters.bypass[cpu->ooo.phys_ready_cycle[phys] == cpu->clock ? BYPASS_EX_MEM
+                                                                       : BYPASS_REGISTER_FILE]++;
+    return cpu->ooo.phys_value[phys];
+}
+
+/* Starts entry on its functional unit. Results are computed now and become
+ * visible to readers once the unit latency has passed. */
+static void
+execute_entry(APEX_CPU *cpu, APEX_RobEntry *entry, const APEX_OpInfo *op)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    CPU_Stage *stage = &entry->stage;
+    const APEX_FUConfig *unit = &cpu->config.fu[op->unit];
+    int flags = entry->src[2] >= 0 ? ooo->phys_value[entry->src[2]] : 0;
+    int ready;
+
+    if (entry->src[0] >= 0)
+    {
+        stage->rs1_value = read_operand(cpu, entry->src[0]);
+    }
+    if (entry->src[1] >= 0)
+    {
+        stage->rs2_value = read_operand(cpu, entry->src[1]);
+    }
+    if (op->exec)
+    {
+        op->exec(stage);
+    }
+
+    stage->complete_cycle = cpu->clock + unit->latency - 1;
+    ready = stage->complete_cycle + 1;
+    if (!unit->pipelined)
+    {
+        cpu->fu_free_cycle[op->unit] = cpu->clock + unit->latency;
+    }
+    if (ooo->unit_busy_until[op->unit] < stage->complete_cycle)
+    {
+        ooo->unit_busy_until[op->unit] = stage->complete_cycle;
+    }
+    cpu->counters.fu_issued[op->unit]++;
+    entry->issued = TRUE;
+    APEX_OBSERVE(cpu, APEX_EVENT_ISSUE, STAGE_EXECUTE, stage, 0, 0, 0);
+
+    /* A loaded rd is written by the data memory access */
+    if (op->mem == MEM_LOAD)
+    {
+        entry->mem_pending = TRUE;
+    }
+    else if (entry->dst[0] >= 0)
+    {
+        ooo->phys_value[entry->dst[0]] = stage->result_buffer;
+        ooo->phys_ready_cycle[entry->dst[0]] = ready;
+    }
+    if (entry->dst[1] >= 0)
+    {
+        ooo->phys_value[entry->dst[1]] =
+            ((op->dst & DST_RS1_POST) ? stage->rs1_value : stage->rs2_value) + 4;
+        ooo->phys_ready_cycle[entry->dst[1]] = ready;
+    }
+    if (entry->dst[2] >= 0)
+    {
+        ooo->phys_value[entry->dst[2]] = APEX_flags_from_result(flags, op->flags,
+                                                                stage->result_buffer);
+        ooo->phys_ready_cycle[entry->dst[2]] = ready;
+    }
+    APEX_stage_event(cpu, STAGE_EXECUTE, stage);
+
+    if (op->ctrl != CTRL_NONE)
+    {
+        int next_pc = APEX_resolve_branch(cpu, stage, op, APEX_condition_holds(flags, op));
+
+        if (next_pc != stage->predicted_pc)
+        {
+            squash_after(cpu, stage, next_pc);
+        }
+    }
+}
+
+/*
+ * Issue Stage of the out-of-order core
+ *
+ * Selects up to width instructions with ready operands from the issue
+ * queue, oldest first. Each cycle accepts width ALU operations and one on
+ * each of the other units, a unit that is not pipelined accepts one per
+ * latency.
+ */
+static void
+ooo_issue(APEX_CPU *cpu)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    int oldest = ooo->iq_count ? ooo->iq[0] : -1;
+    int waiting = FALSE;
+    int issued = 0;
+    int alus = 0;
+    int units = 0;
+    int i = 0;
+
+    while (i < ooo->iq_count && issued < cpu->config.width)
+    {
+        APEX_RobEntry *entry = &ooo->rob[ooo->iq[i]];
+        const APEX_OpInfo *op = &apex_op_table[entry->stage.insn->opcode];
+
+        if (!operands_ready(cpu, entry))
+        {
+            waiting = TRUE;
+            i++;
+            continue;
+        }
+        if ((op->unit == FU_ALU ? alus == cpu->config.width : (units & (1 << op->unit)) != 0) ||
+            cpu->fu_free_cycle[op->unit] > cpu->clock)
+        {
+            i++;
+            continue;
+        }
+        alus += op->unit == FU_ALU;
+        units |= 1 << op->unit;
+        issued++;
+
+        /* Younger entries are squashed if it is a mispredicted branch */
+        ooo->iq_count--;
+        memmove(&ooo->iq[i], &ooo->iq[i + 1], (ooo->iq_count - i) * sizeof(int));
+        execute_entry(cpu, entry, op);
+    }
+
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        cpu->counters.fu_busy[i] += ooo->unit_busy_until[i] >= cpu->clock;
+    }
+    if (issued)
+    {
+        cpu->counters.issued[issued]++;
+    }
+    else if (oldest >= 0)
+    {
+        /* Nothing in the window could hide the latency */
+        APEX_count_stall(cpu, waiting ? STALL_LOAD_USE : STALL_FU_BUSY, STAGE_EXECUTE,
+                         &ooo->rob[oldest].stage);
+    }
+}
+
+/* Completes the load in entry at once with value */
+static void
+complete_load(APEX_CPU *cpu, APEX_RobEntry *entry, int value, int latency)
+{
+    entry->stage.result_buffer = value;
+    entry->stage.complete_cycle = cpu->clock + latency - 1;
+    entry->mem_pending = FALSE;
+    cpu->ooo.phys_value[entry->dst[0]] = value;
+    cpu->ooo.phys_ready_cycle[entry->dst[0]] = entry->stage.complete_cycle + 1;
+    APEX_stage_event(cpu, STAGE_MEMORY, &entry->stage);
+}
+
+/*
+ * Memory Stage of the out-of-order core
+ *
+ * A load with its address waits until every older store has computed its
+ * address. It then takes the data of the youngest older store to the same
+ * address, or reads data memory through its single port.
+ */
+static void
+ooo_memory(APEX_CPU *cpu)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    int unknown_store = FALSE;
+    int port_free = ooo->mem_port_free_cycle <= cpu->clock;
+    int i, j;
+
+    for (i = 0; i < ooo->lsq_count; ++i)
+    {
+        APEX_RobEntry *entry = &ooo->rob[ooo->lsq[i]];
+        const CPU_Stage *stage = &entry->stage;
+        int address_known = entry->issued && stage->complete_cycle < cpu->clock;
+
+        if (apex_op_table[stage->insn->opcode].mem == MEM_STORE)
+        {
+            unknown_store |= !address_known;
+            continue;
+        }
+        if (!entry->mem_pending || !address_known || unknown_store)
+        {
+            continue;
+        }
+
+        for (j = i - 1; j >= 0; --j)
+        {
+            const CPU_Stage *store = &ooo->rob[ooo->lsq[j]].stage;
+
+            if (apex_op_table[store->insn->opcode].mem == MEM_STORE &&
+                store->memory_address == stage->memory_address)
+            {
+                break;
+            }
+        }
+        if (j >= 0)
+        {
+            cpu->counters.store_forwards++;
+            complete_load(cpu, entry, ooo->rob[ooo->lsq[j]].stage.rs1_value, 1);
+        }
+        else if (!APEX_mem_in_range(cpu, stage->memory_address))
+        {
+            /* Faults if it retires, it may be on a mispredicted path */
+            entry->fault = TRUE;
+            complete_load(cpu, entry, 0, 1);
+        }
+        else if (port_free)
+        {
+            int latency = APEX_data_access_latency(cpu, stage->memory_address, FALSE);
+            int value = 0;
+
+            APEX_mem_read(cpu, stage->memory_address, &value);
+            APEX_OBSERVE(cpu, APEX_EVENT_MEM_ACCESS, STAGE_MEMORY, stage, FALSE, stage->memory_address,
+                         value);
+            ooo->mem_port_free_cycle = cpu->clock + latency;
+            port_free = FALSE;
+            complete_load(cpu, entry, value, latency);
+        }
+        else
+        {
+            APEX_count_stall(cpu, STALL_MEMORY_BUSY, STAGE_MEMORY, stage);
+        }
+    }
+}
+
+/* Stops the core on an access outside data memory by the retiring entry */
+static void
+memory_fault(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    cpu->mem_fault = TRUE;
+    cpu->mem_fault_pc = stage->pc;
+    cpu->mem_fault_address = stage->memory_address;
+}
+
+/*
+ * Retire Stage of the out-of-order core, commits up to width completed
+ * instructions in program order
+ *
+ * Returns TRUE once HALT has retired or on a data memory fault
+ */
+static int
+ooo_retire(APEX_CPU *cpu)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+    int n, k;
+
+    for (n = 0; n < cpu->config.width && ooo->rob_count; ++n)
+    {
+        APEX_RobEntry *entry = &ooo->rob[ooo->rob_head];
+        const CPU_Stage *stage = &entry->stage;
+        const APEX_Instruction *ins = stage->insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+
+        if (!entry->issued || entry->mem_pending || stage->complete_cycle >= cpu->clock)
+        {
+            break;
+        }
+
+        if (op->mem != MEM_NONE && (entry->fault || !APEX_mem_in_range(cpu, stage->memory_address)))
+        {
+            memory_fault(cpu, stage);
+            return TRUE;
+        }
+        if (op->mem == MEM_STORE)
+        {
+            if (ooo->mem_port_free_cycle > cpu->clock)
+            {
+                APEX_count_stall(cpu, STALL_MEMORY_BUSY, STAGE_WRITEBACK, stage);
+                break;
+            }
+            ooo->mem_port_free_cycle =
+                cpu->clock + APEX_data_access_latency(cpu, stage->memory_address, TRUE);
+            APEX_mem_write(cpu, stage->memory_address, stage->rs1_value);
+            APEX_OBSERVE(cpu, APEX_EVENT_MEM_ACCESS, STAGE_WRITEBACK, stage, TRUE, stage->memory_address,
+                         stage->rs1_value);
+        }
+
+        for (k = 0; k < 3; ++k)
+        {
+            if (entry->dst[k] < 0)
+            {
+                continue;
+            }
+            if (entry->arch_dst[k] == FLAGS_REG)
+            {
+                int flags = ooo->phys_value[entry->dst[k]];
+
+                cpu->zero_flag = (flags & FLAG_Z) != 0;
+                cpu->positive_flag = (flags & FLAG_P) != 0;
+                cpu->negative_flag = (flags & FLAG_N) != 0;
+            }
+            else
+            {
+                cpu->regs[entry->arch_dst[k]] = ooo->phys_value[entry->dst[k]];
+            }
+            ooo->free_list[ooo->free_count++] = entry->old_dst[k];
+        }
+
+        cpu->insn_completed++;
+        cpu->counters.retired++;
+        cpu->counters.retired_by_opcode[ins->opcode]++;
+        if (cpu->profile)
+        {
+            APEX_profile_entry(cpu, stage->pc)->executions++;
+        }
+        APEX_OBSERVE(cpu, APEX_EVENT_RETIRE, STAGE_WRITEBACK, stage, 0, 0, 0);
+        APEX_stage_event(cpu, STAGE_WRITEBACK, stage);
+
+        ooo->rob_head = rob_index(cpu, 1);
+        ooo->rob_count--;
+        if (op->mem != MEM_NONE)
+        {
+            ooo->lsq_count--;
+            memmove(&ooo->lsq[0], &ooo->lsq[1], ooo->lsq_count * sizeof(int));
+        }
+
+        if (ins->opcode == OPCODE_HALT)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Simulates one clock cycle of the out-of-order core, stages are called in
+ * reverse order as in the in-order pipelines.
+ *
+ * Returns TRUE once HALT has retired or on a data memory or fetch fault.
+ */
+int
+APEX_ooo_cycle(APEX_CPU *cpu)
+{
+    APEX_OutOfOrder *ooo = &cpu->ooo;
+
+    if (!ooo->active)
+    {
+        ooo_start(cpu);
+    }
+
+    /* Occupancy is sampled as the cycle starts */
+    cpu->counters.occupancy[STAGE_FETCH] += cpu->fetch.has_insn || cpu->wide[STAGE_FETCH].count;
+    cpu->counters.occupancy[STAGE_DECODE] += cpu->wide[STAGE_DECODE].count > 0;
+    cpu->counters.occupancy[STAGE_EXECUTE] += ooo->iq_count > 0;
+    cpu->counters.occupancy[STAGE_MEMORY] += ooo->lsq_count > 0;
+    cpu->counters.occupancy[STAGE_WRITEBACK] += ooo->rob_count > 0;
+    cpu->counters.rob_entries += ooo->rob_count;
+    cpu->counters.iq_entries += ooo->iq_count;
+    cpu->counters.lsq_entries += ooo->lsq_count;
+    if (cpu->profile)
+    {
+        profile_cycle(cpu);
+    }
+
+    if (ooo_retire(cpu))
+    {
+        return TRUE;
+    }
+    ooo_memory(cpu);
+    ooo_issue(cpu);
+    ooo_rename(cpu);
+    APEX_wide_fetch(cpu);
+    return APEX_fetch_faulted(cpu, ooo->rob_count == 0 && cpu->wide[STAGE_DECODE].count == 0 &&
+                                       cpu->wide[STAGE_FETCH].count == 0);
+}
@@ -0,0 +1,208 @@
+/*
+ * apex_ops.c
+ * Contains the per-opcode handler table used by the pipeline stages
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stddef.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+static void
+exec_add(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value + stage->rs2_value;
+}
+
+static void
+exec_addl(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value + stage->insn->imm;
+}
+
+static void
+exec_sub(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value - stage->rs2_value;
+}
+
+static void
+exec_subl(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value - stage->insn->imm;
+}
+
+static void
+exec_mul(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value * stage->rs2_value;
+}
+
+/* Division truncates toward zero. Dividing by zero gives 0 and the one
+ * overflowing quotient wraps, so a program cannot stop the simulator */
+static void
+exec_div(CPU_Stage *stage)
+{
+    if (stage->rs2_value == 0)
+    {
+        stage->result_buffer = 0;
+    }
+    else if (stage->rs2_value == -1)
+    {
+        stage->result_buffer = (int)(0U - (unsigned int)stage->rs1_value);
+    }
+    else
+    {
+        stage->result_buffer = stage->rs1_value / stage->rs2_value;
+    }
+}
+
+static void
+exec_and(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value & stage->rs2_value;
+}
+
+static void
+exec_or(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value | stage->rs2_value;
+}
+
+static void
+exec_xor(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+}
+
+static void
+exec_movc(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->insn->imm;
+}
+
+/* LOAD, LOADP: address is rs1 + imm */
+static void
+exec_load_address(CPU_Stage *stage)
+{
+    stage->memory_address = stage->rs1_value + stage->insn->imm;
+}
+
+/* STORE, STOREP: rs1 is the data, address is rs2 + imm */
+static void
+exec_store_address(CPU_Stage *stage)
+{
+    stage->memory_address = stage->rs2_value + stage->insn->imm;
+}
+
+/* JALR: return address is written to rd */
+static void
+exec_link(CPU_Stage *stage)
+{
+    stage->result_buffer = stage->pc + 4;
+}
+
+/* Sets the condition flags selected by mask from an execute result */
+void
+APEX_update_flags(APEX_CPU *cpu, int mask, int result)
+{
+    if (mask & FLAG_Z)
+    {
+        cpu->zero_flag = (result == 0);
+    }
+    if (mask & FLAG_P)
+    {
+        cpu->positive_flag = (result > 0);
+    }
+    if (mask & FLAG_N)
+    {
+        cpu->negative_flag = (result < 0);
+    }
+}
+
+/* Returns the FLAG_* bits flags with those selected by mask set from an
+ * execute result, the renamed form of APEX_update_flags */
+int
+APEX_flags_from_result(int flags, int mask, int result)
+{
+    flags &= ~mask;
+    if ((mask & FLAG_Z) && result == 0)
+    {
+        flags |= FLAG_Z;
+    }
+    if ((mask & FLAG_P) && result > 0)
+    {
+        flags |= FLAG_P;
+    }
+    if ((mask & FLAG_N) && result < 0)
+    {
+        flags |= FLAG_N;
+    }
+    return flags;
+}
+
+/* Evaluates the branch condition of op against the FLAG_* bits in flags */
+int
+APEX_condition_holds(int flags, const APEX_OpInfo *op)
+{
+    if (!op->cond_flags)
+    {
+        /* Unconditional */
+        return TRUE;
+    }
+    return ((flags & op->cond_flags) != 0) == op->cond_value;
+}
+
+/* Evaluates the branch condition of op against the current flags */
+int
+APEX_branch_taken(const APEX_CPU *cpu, const APEX_OpInfo *op)
+{
+    int flag_value;
+
+    switch (op->cond_flags)
+    {
+    case FLAG_Z:
+        flag_value = cpu->zero_flag;
+        break;
+    case FLAG_P:
+        flag_value = cpu->positive_flag;
+        break;
+    case FLAG_N:
+        flag_value = cpu->negative_flag;
+        break;
+    default:
+        /* Unconditional */
+        return TRUE;
+    }
+    return flag_value == op->cond_value;
+}
+
+const APEX_OpInfo apex_op_table[NUM_OPCODES] = {
+    [OPCODE_ADD] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_add},
+    [OPCODE_SUB] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_sub},
+    [OPCODE_MUL] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_MUL, exec_mul},
+    [OPCODE_DIV] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_DIV, exec_div},
+    [OPCODE_AND] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_and},
+    [OPCODE_OR] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_or},
+    [OPCODE_XOR] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_xor},
+    [OPCODE_ADDL] = {SRC_RS1, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_addl},
+    [OPCODE_SUBL] = {SRC_RS1, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_subl},
+    [OPCODE_MOVC] = {0, FLAG_Z, MEM_NONE, CTRL_NONE, 0, 0, DST_RD, FU_ALU, exec_movc},
+    [OPCODE_LOAD] = {SRC_RS1, 0, MEM_LOAD, CTRL_NONE, 0, 0, DST_RD, FU_AGU, exec_load_address},
+    [OPCODE_LOADP] = {SRC_RS1, 0, MEM_LOAD, CTRL_NONE, 0, 0, DST_RD | DST_RS1_POST, FU_AGU, exec_load_address},
+    [OPCODE_STORE] = {SRC_RS1 | SRC_RS2, 0, MEM_STORE, CTRL_NONE, 0, 0, 0, FU_AGU, exec_store_address},
+    [OPCODE_STOREP] = {SRC_RS1 | SRC_RS2, 0, MEM_STORE, CTRL_NONE, 0, 0, DST_RS2_POST, FU_AGU, exec_store_address},
+    [OPCODE_CML] = {SRC_RS1, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, 0, FU_ALU, exec_subl},
+    [OPCODE_CMP] = {SRC_RS1 | SRC_RS2, FLAG_ALL, MEM_NONE, CTRL_NONE, 0, 0, 0, FU_ALU, exec_sub},
+    [OPCODE_BZ] = {0, 0, MEM_NONE, CTRL_PC_REL, FLAG_Z, TRUE, 0, FU_ALU, NULL},
+    [OPCODE_BNZ] = {0, 0, MEM_NONE, CTRL_PC_REL, FLAG_Z, FALSE, 0, FU_ALU, NULL},
+    [OPCODE_BP] = {0, 0, MEM_NONE, CTRL_PC_REL, FLAG_P, TRUE, 0, FU_ALU, NULL},
+    [OPCODE_BNP] = {0, 0, MEM_NONE, CTRL_PC_REL, FLAG_P, FALSE, 0, FU_ALU, NULL},
+    [OPCODE_BN] = {0, 0, MEM_NONE, CTRL_PC_REL, FLAG_N, TRUE, 0, FU_ALU, NULL},
+    [OPCODE_BNN] = {0, 0, MEM_NONE, CTRL_PC_REL, FLAG_N, FALSE, 0, FU_ALU, NULL},
+    [OPCODE_JUMP] = {SRC_RS1, 0, MEM_NONE, CTRL_REG, 0, 0, 0, FU_ALU, NULL},
+    [OPCODE_JALR] = {SRC_RS1, 0, MEM_NONE, CTRL_REG, 0, 0, DST_RD, FU_ALU, exec_link},
+};
@@ -0,0 +1,239 @@
+/*
+ * apex_stats.c
+ * Contains the export of the APEX performance counters as JSON or CSV
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+const char *const apex_stage_names[NUM_STAGES] = {
+    "fetch", "decode", "execute", "memory", "writeback"};
+
+const char *const apex_stall_cause_names[NUM_STALL_CAUSES] = {
+    "load_use", "raw", "execute_busy", "memory_busy", "memory_latency", "icache",
+    "functional_unit", "structural", "rob_full", "iq_full", "lsq_full", "free_list"};
+
+const char *const apex_fu_names[NUM_FUS] = {"alu", "mul", "div", "agu"};
+
+const char *const apex_bypass_names[NUM_BYPASS_PATHS] = {
+    "register_file", "ex_mem", "mem_wb", "store_data"};
+
+static double
+cycles_per_insn(const APEX_Counters *counters)
+{
+    return counters->retired ? (double)counters->cycles / counters->retired : 0.0;
+}
+
+/* Fraction of control instructions fetch continued correctly after */
+static double
+prediction_accuracy(const APEX_Counters *counters)
+{
+    return counters->branches
+               ? (double)(counters->branches - counters->mispredicts) / counters->branches
+               : 0.0;
+}
+
+/* Fraction of cycles the unit computed at least one operation */
+static double
+fu_utilization(const APEX_Counters *counters, int unit)
+{
+    return counters->cycles ? (double)counters->fu_busy[unit] / counters->cycles : 0.0;
+}
+
+/* Cycles decode issued n instructions, those that issued none are the
+ * remainder */
+static long
+issue_cycles(const APEX_CPU *cpu, int n)
+{
+    long cycles = cpu->counters.cycles;
+    int i;
+
+    if (n > 0)
+    {
+        return cpu->counters.issued[n];
+    }
+    for (i = 1; i <= cpu->config.width; ++i)
+    {
+        cycles -= cpu->counters.issued[i];
+    }
+    return cycles;
+}
+
+/* Entries of an out-of-order structure on average over the cycles */
+static double
+average_entries(const APEX_Counters *counters, long entries)
+{
+    return counters->cycles ? (double)entries / counters->cycles : 0.0;
+}
+
+static double
+cache_hit_rate(const APEX_Cache *cache)
+{
+    return cache->accesses ? (double)cache->hits / cache->accesses : 0.0;
+}
+
+static void
+write_cache_json(FILE *fp, const char *name, const APEX_Cache *cache)
+{
+    fprintf(fp, "  \"%s\": {\"accesses\": %ld, \"hits\": %ld, \"misses\": %ld, "
+                "\"hit_rate\": %.4f, \"evictions\": %ld, \"writebacks\": %ld, \"prefetches\": %ld},\n",
+            name, cache->accesses, cache->hits, cache->misses, cache_hit_rate(cache),
+            cache->evictions, cache->writebacks, cache->prefetches);
+}
+
+static void
+write_cache_csv(FILE *fp, const char *name, const APEX_Cache *cache)
+{
+    fprintf(fp, "%s.accesses,%ld\n", name, cache->accesses);
+    fprintf(fp, "%s.hits,%ld\n", name, cache->hits);
+    fprintf(fp, "%s.misses,%ld\n", name, cache->misses);
+    fprintf(fp, "%s.hit_rate,%.4f\n", name, cache_hit_rate(cache));
+    fprintf(fp, "%s.evictions,%ld\n", name, cache->evictions);
+    fprintf(fp, "%s.writebacks,%ld\n", name, cache->writebacks);
+    fprintf(fp, "%s.prefetches,%ld\n", name, cache->prefetches);
+}
+
+/* Writes the counters as one JSON object */
+void
+APEX_stats_write_json(const APEX_CPU *cpu, FILE *fp)
+{
+    const APEX_Counters *counters = &cpu->counters;
+    const char *sep;
+    int i;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"cycles\": %ld,\n", counters->cycles);
+    fprintf(fp, "  \"retired\": %ld,\n", counters->retired);
+    fprintf(fp, "  \"cpi\": %.3f,\n", cycles_per_insn(counters));
+
+    fprintf(fp, "  \"stalls\": {");
+    for (i = 0; i < NUM_STALL_CAUSES; ++i)
+    {
+        fprintf(fp, "%s\"%s\": %ld", i ? ", " : "", apex_stall_cause_names[i],
+                counters->stalls[i]);
+    }
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"flushed\": %ld,\n", counters->flushed);
+    fprintf(fp, "  \"fetch_bubbles\": %ld,\n", counters->fetch_bubbles);
+    fprintf(fp, "  \"branches\": %ld,\n", counters->branches);
+    fprintf(fp, "  \"taken_branches\": %ld,\n", counters->taken_branches);
+    fprintf(fp, "  \"mispredicts\": %ld,\n", counters->mispredicts);
+    fprintf(fp, "  \"prediction_accuracy\": %.4f,\n", prediction_accuracy(counters));
+    write_cache_json(fp, "dcache", &cpu->dcache);
+    write_cache_json(fp, "icache", &cpu->icache);
+
+    /* Opcodes that never retired are left out */
+    fprintf(fp, "  \"retired_by_opcode\": {");
+    sep = "";
+    for (i = 0; i < NUM_OPCODES; ++i)
+    {
+        if (counters->retired_by_opcode[i])
+        {
+            fprintf(fp, "%s\"%s\": %ld", sep, get_opcode_str(i), counters->retired_by_opcode[i]);
+            sep = ", ";
+        }
+    }
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"occupancy\": {");
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        fprintf(fp, "%s\"%s\": %ld", i ? ", " : "", apex_stage_names[i],
+                counters->occupancy[i]);
+    }
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"bypass\": {");
+    for (i = 0; i < NUM_BYPASS_PATHS; ++i)
+    {
+        fprintf(fp, "%s\"%s\": %ld", i ? ", " : "", apex_bypass_names[i], counters->bypass[i]);
+    }
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"functional_units\": {");
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        fprintf(fp, "%s\"%s\": {\"issued\": %ld, \"busy\": %ld, \"utilization\": %.4f}",
+                i ? ", " : "", apex_fu_names[i], counters->fu_issued[i], counters->fu_busy[i],
+                fu_utilization(counters, i));
+    }
+    fprintf(fp, "},\n");
+
+    /* Cycles decode issued 0 to width instructions */
+    fprintf(fp, "  \"issued_per_cycle\": [");
+    for (i = 0; i <= cpu->config.width; ++i)
+    {
+        fprintf(fp, "%s%ld", i ? ", " : "", issue_cycles(cpu, i));
+    }
+    fprintf(fp, "],\n");
+
+    fprintf(fp, "  \"out_of_order\": {\"rob_average\": %.4f, \"iq_average\": %.4f, "
+                "\"lsq_average\": %.4f, \"store_forwards\": %ld}\n",
+            average_entries(counters, counters->rob_entries),
+            average_entries(counters, counters->iq_entries),
+            average_entries(counters, counters->lsq_entries), counters->store_forwards);
+    fprintf(fp, "}\n");
+}
+
+/* Writes the counters as counter,value rows, grouped counters are named
+ * group.member */
+void
+APEX_stats_write_csv(const APEX_CPU *cpu, FILE *fp)
+{
+    const APEX_Counters *counters = &cpu->counters;
+    int i;
+
+    fprintf(fp, "counter,value\n");
+    fprintf(fp, "cycles,%ld\n", counters->cycles);
+    fprintf(fp, "retired,%ld\n", counters->retired);
+    fprintf(fp, "cpi,%.3f\n", cycles_per_insn(counters));
+    for (i = 0; i < NUM_STALL_CAUSES; ++i)
+    {
+        fprintf(fp, "stalls.%s,%ld\n", apex_stall_cause_names[i], counters->stalls[i]);
+    }
+    fprintf(fp, "flushed,%ld\n", counters->flushed);
+    fprintf(fp, "fetch_bubbles,%ld\n", counters->fetch_bubbles);
+    fprintf(fp, "branches,%ld\n", counters->branches);
+    fprintf(fp, "taken_branches,%ld\n", counters->taken_branches);
+    fprintf(fp, "mispredicts,%ld\n", counters->mispredicts);
+    fprintf(fp, "prediction_accuracy,%.4f\n", prediction_accuracy(counters));
+    write_cache_csv(fp, "dcache", &cpu->dcache);
+    write_cache_csv(fp, "icache", &cpu->icache);
+    for (i = 0; i < NUM_OPCODES; ++i)
+    {
+        if (counters->retired_by_opcode[i])
+        {
+            fprintf(fp, "retired_by_opcode.%s,%ld\n", get_opcode_str(i),
+                    counters->retired_by_opcode[i]);
+        }
+    }
+    for (i = 0; i < NUM_STAGES; ++i)
+    {
+        fprintf(fp, "occupancy.%s,%ld\n", apex_stage_names[i], counters->occupancy[i]);
+    }
+    for (i = 0; i < NUM_BYPASS_PATHS; ++i)
+    {
+        fprintf(fp, "bypass.%s,%ld\n", apex_bypass_names[i], counters->bypass[i]);
+    }
+    for (i = 0; i < NUM_FUS; ++i)
+    {
+        fprintf(fp, "functional_units.%s.issued,%ld\n", apex_fu_names[i], counters->fu_issued[i]);
+        fprintf(fp, "functional_units.%s.busy,%ld\n", apex_fu_names[i], counters->fu_busy[i]);
+        fprintf(fp, "functional_units.%s.utilization,%.4f\n", apex_fu_names[i],
+                fu_utilization(counters, i));
+    }
+    for (i = 0; i <= cpu->config.width; ++i)
+    {
+        fprintf(fp, "issued_per_cycle.%d,%ld\n", i, issue_cycles(cpu, i));
+    }
+    fprintf(fp, "out_of_order.rob_average,%.4f\n", average_entries(counters, counters->rob_entries));
+    fprintf(fp, "out_of_order.iq_average,%.4f\n", average_entries(counters, counters->iq_entries));
+    fprintf(fp, "out_of_order.lsq_average,%.4f\n", average_entries(counters, counters->lsq_entries));
+    fprintf(fp, "out_of_order.store_forwards,%ld\n", counters->store_forwards);
+}
@@ -0,0 +1,183 @@
+/*
+ * apex_trace.c
+ * Contains the binary pipeline trace. The pipeline records one fixed-size
+ * APEX_TraceRecord per stage event, the records are buffered in memory and
+ * written in large blocks. apex-trace decodes the file.
+ *
+ * File layout: header, code_memory_size instructions, then records to the
+ * end of the file. The code memory lets the decoder print instructions
+ * without the program.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define TRACE_MAGIC "APXT"
+#define TRACE_VERSION 2
+
+typedef struct APEX_TraceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t instruction_size;
+    int32_t code_memory_size;
+    uint32_t reserved;
+} APEX_TraceHeader;
+
+/* Stage names as printed in the pipeline display */
+const char *const apex_stage_titles[NUM_STAGES] = {
+    "Fetch", "Decode/RF", "Execute", "Memory", "Writeback"};
+
+/*
+ * Starts tracing cpu to filename, the code memory is written first. Only
+ * events of cycles first_cycle to last_cycle are recorded, so that a long
+ * run can be traced around the region of interest at little cost.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+APEX_trace_open(APEX_CPU *cpu, const char *filename, int first_cycle, int last_cycle)
+{
+    APEX_TraceHeader header;
+    APEX_Trace *trace;
+
+    trace = malloc(sizeof(APEX_Trace));
+    if (!trace)
+    {
+        return -1;
+    }
+    trace->fp = fopen(filename, "wb");
+    if (!trace->fp)
+    {
+        free(trace);
+        return -1;
+    }
+    trace->first_cycle = first_cycle;
+    trace->last_cycle = last_cycle;
+    trace->count = 0;
+    trace->failed = FALSE;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(APEX_TraceRecord);
+    header.instruction_size = sizeof(APEX_Instruction);
+    header.code_memory_size = cpu->code_memory_size;
+    if (fwrite(&header, sizeof(header), 1, trace->fp) != 1 ||
+        fwrite(cpu->code_memory, sizeof(APEX_Instruction), cpu->code_memory_size, trace->fp) !=
+            (size_t)cpu->code_memory_size)
+    {
+        fclose(trace->fp);
+        free(trace);
+        return -1;
+    }
+
+    cpu->trace = trace;
+    return 0;
+}
+
+/* Writes out the buffered records */
+void
+APEX_trace_flush(APEX_Trace *trace)
+{
+    if (trace->count > 0 &&
+        fwrite(trace->records, sizeof(APEX_TraceRecord), trace->count, trace->fp) !=
+            (size_t)trace->count)
+    {
+        trace->failed = TRUE;
+    }
+    trace->count = 0;
+}
+
+/*
+ * Writes out the remaining records and stops tracing.
+ *
+ * Returns 0 if the complete trace was written, -1 otherwise.
+ */
+int
+APEX_trace_close(APEX_CPU *cpu)
+{
+    APEX_Trace *trace = cpu->trace;
+    int failed;
+
+    if (!trace)
+    {
+        return 0;
+    }
+    APEX_trace_flush(trace);
+    failed = trace->failed;
+    if (fclose(trace->fp) != 0)
+    {
+        failed = TRUE;
+    }
+    free(trace);
+    cpu->trace = NULL;
+    return failed ? -1 : 0;
+}
+
+/*
+ * Maps a trace file for reading. The code memory and records are used in
+ * place from the mapping, which the caller releases with munmap.
+ *
+ * Returns the first record, or NULL if the file is not a valid trace.
+ */
+const APEX_TraceRecord *
+APEX_trace_map(const char *filename, const APEX_Instruction **code_memory,
+               int *code_memory_size, long *num_records, void **map, size_t *map_size)
+{
+    const APEX_TraceHeader *header;
+    size_t records_offset;
+    struct stat st;
+    void *addr;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header))
+    {
+        close(fd);
+        return NULL;
+    }
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    header = addr;
+    records_offset = sizeof(*header) + (size_t)header->code_memory_size * sizeof(APEX_Instruction);
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TRACE_VERSION ||
+        header->record_size != sizeof(APEX_TraceRecord) ||
+        header->instruction_size != sizeof(APEX_Instruction) ||
+        header->code_memory_size < 0 || records_offset > (size_t)st.st_size ||
+        (st.st_size - records_offset) % sizeof(APEX_TraceRecord) != 0)
+    {
+        munmap(addr, st.st_size);
+        return NULL;
+    }
+
+    *code_memory = (const APEX_Instruction *)(header + 1);
+    *code_memory_size = header->code_memory_size;
+    *num_records = (st.st_size - records_offset) / sizeof(APEX_TraceRecord);
+    *map = addr;
+    *map_size = st.st_size;
+    return (const APEX_TraceRecord *)((const char *)addr + records_offset);
+}
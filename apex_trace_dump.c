@@ -0,0 +1,308 @@
+/*
+ * apex_trace_dump.c
+ * apex-trace: decodes a binary pipeline trace written by apex_sim --trace
+ * back into the per-cycle pipeline display, or into a Konata log showing
+ * the lifetime of every instruction, optionally limited to a range of
+ * cycles or to one instruction
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Most instructions in flight at once that the Konata export follows */
+#define KONATA_MAX_LIVE 64
+
+/* Stage names in the Konata pipeline view */
+static const char *const konata_stages[NUM_STAGES] = {"F", "D", "X", "M", "W"};
+
+/* An instruction in flight in the Konata export */
+typedef struct KonataInsn
+{
+    uint32_t seq;
+    long id;        /* Konata instruction id */
+    int stage;      /* Current STAGE_* */
+    int last_cycle; /* Last cycle it was seen in a stage */
+} KonataInsn;
+
+typedef struct KonataLog
+{
+    KonataInsn live[KONATA_MAX_LIVE];
+    int num_live;
+    long next_id;
+    long next_retire_id;
+    int cycle; /* Cycle the log is positioned at */
+} KonataLog;
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <trace_file> [--cycles <first>:<last>] [--pc <pc>] [--events] [--konata]\n",
+            prog);
+    exit(1);
+}
+
+/* Returns the live instruction seq, starting it if this is its first
+ * record. Returns NULL if too many instructions are in flight. */
+static KonataInsn *
+konata_insn(KonataLog *log, const APEX_TraceRecord *record,
+            const APEX_Instruction *code_memory, int code_memory_size)
+{
+    int index = (record->pc - 4000) / 4;
+    KonataInsn *insn;
+    int i;
+
+    for (i = 0; i < log->num_live; ++i)
+    {
+        if (log->live[i].seq == record->seq)
+        {
+            return &log->live[i];
+        }
+    }
+    if (log->num_live == KONATA_MAX_LIVE)
+    {
+        return NULL;
+    }
+
+    insn = &log->live[log->num_live++];
+    insn->seq = record->seq;
+    insn->id = log->next_id++;
+    insn->stage = -1;
+    insn->last_cycle = record->cycle;
+    printf("I\t%ld\t%u\t0\n", insn->id, record->seq);
+    printf("L\t%ld\t0\t%d: ", insn->id, record->pc);
+    if (record->pc >= 4000 && index < code_memory_size)
+    {
+        print_instruction(stdout, &code_memory[index]);
+    }
+    printf("\n");
+    return insn;
+}
+
+/* Ends the instructions that left the pipeline before the current cycle,
+ * they retired if they were last in Writeback and were flushed otherwise */
+static void
+konata_end_cycle(KonataLog *log)
+{
+    int i = 0;
+
+    while (i < log->num_live)
+    {
+        KonataInsn *insn = &log->live[i];
+
+        if (insn->last_cycle < log->cycle)
+        {
+            printf("E\t%ld\t0\t%s\n", insn->id, konata_stages[insn->stage]);
+            if (insn->stage == STAGE_WRITEBACK)
+            {
+                printf("R\t%ld\t%ld\t0\n", insn->id, log->next_retire_id++);
+            }
+            else
+            {
+                printf("R\t%ld\t0\t1\n", insn->id);
+            }
+            log->live[i] = log->live[--log->num_live];
+            continue;
+        }
+        i++;
+    }
+}
+
+/* Adds one record to the Konata log */
+static void
+konata_record(KonataLog *log, const APEX_TraceRecord *record,
+              const APEX_Instruction *code_memory, int code_memory_size)
+{
+    KonataInsn *insn;
+
+    if (record->cycle != log->cycle)
+    {
+        /* Close the previous cycle, then advance to this one */
+        konata_end_cycle(log);
+        printf("C\t%d\n", record->cycle - log->cycle);
+        log->cycle = record->cycle;
+    }
+
+    insn = konata_insn(log, record, code_memory, code_memory_size);
+    if (!insn)
+    {
+        return;
+    }
+    insn->last_cycle = record->cycle;
+
+    switch (record->event)
+    {
+    case TRACE_STAGE:
+    {
+        if (insn->stage != record->stage)
+        {
+            if (insn->stage >= 0)
+            {
+                printf("E\t%ld\t0\t%s\n", insn->id, konata_stages[insn->stage]);
+            }
+            printf("S\t%ld\t0\t%s\n", insn->id, konata_stages[record->stage]);
+            insn->stage = record->stage;
+        }
+        break;
+    }
+    case TRACE_STALL:
+    {
+        printf("L\t%ld\t1\tcycle %d: stall %s; \n", insn->id, record->cycle,
+               record->aux < NUM_STALL_CAUSES ? apex_stall_cause_names[record->aux] : "???");
+        break;
+    }
+    case TRACE_FLUSH:
+    {
+        printf("L\t%ld\t1\tcycle %d: taken, %d squashed; \n", insn->id, record->cycle,
+               record->aux);
+        break;
+    }
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    const APEX_TraceRecord *records;
+    const APEX_Instruction *code_memory;
+    int code_memory_size;
+    long num_records, i;
+    void *map;
+    size_t map_size;
+    long first_cycle = 0, last_cycle = -1;
+    int filter_pc = FALSE, pc = 0;
+    int events = FALSE;
+    int konata = FALSE;
+    KonataLog *log = NULL;
+    long shown_cycle = -1;
+    int arg;
+
+    if (argc < 2)
+    {
+        usage(argv[0]);
+    }
+    for (arg = 2; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc)
+        {
+            if (sscanf(argv[++arg], "%ld:%ld", &first_cycle, &last_cycle) != 2)
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(argv[arg], "--pc") == 0 && arg + 1 < argc)
+        {
+            filter_pc = TRUE;
+            pc = atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "--events") == 0)
+        {
+            events = TRUE;
+        }
+        else if (strcmp(argv[arg], "--konata") == 0)
+        {
+            konata = TRUE;
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    records = APEX_trace_map(argv[1], &code_memory, &code_memory_size, &num_records, &map,
+                             &map_size);
+    if (!records)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a valid trace\n", argv[1]);
+        exit(1);
+    }
+
+    if (konata)
+    {
+        log = calloc(1, sizeof(KonataLog));
+        if (!log)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory\n");
+            exit(1);
+        }
+        events = TRUE;
+    }
+
+    for (i = 0; i < num_records; ++i)
+    {
+        const APEX_TraceRecord *record = &records[i];
+        int index = (record->pc - 4000) / 4;
+
+        if (record->cycle < first_cycle || (last_cycle >= 0 && record->cycle > last_cycle) ||
+            (filter_pc && record->pc != pc) || (!events && record->event != TRACE_STAGE) ||
+            record->stage >= NUM_STAGES)
+        {
+            continue;
+        }
+
+        if (log)
+        {
+            if (!log->cycle)
+            {
+                printf("Kanata\t0004\n");
+                printf("C=\t%d\n", record->cycle);
+                log->cycle = record->cycle;
+            }
+            konata_record(log, record, code_memory, code_memory_size);
+            continue;
+        }
+
+        /* Same cycle banner as the simulator display */
+        if (record->cycle != shown_cycle)
+        {
+            printf("--------------------------------------------\n");
+            printf("Clock Cycle: %d\n", record->cycle);
+            printf("--------------------------------------------\n");
+            shown_cycle = record->cycle;
+        }
+
+        switch (record->event)
+        {
+        case TRACE_STAGE:
+        {
+            printf("%-15s: pc(%d) ", apex_stage_titles[record->stage], record->pc);
+            if (record->pc >= 4000 && index < code_memory_size)
+            {
+                print_instruction(stdout, &code_memory[index]);
+            }
+            printf("\n");
+            break;
+        }
+        case TRACE_STALL:
+        {
+            printf("%-15s: pc(%d) stall %s\n", apex_stage_titles[record->stage], record->pc,
+                   record->aux < NUM_STALL_CAUSES ? apex_stall_cause_names[record->aux] : "???");
+            break;
+        }
+        case TRACE_FLUSH:
+        {
+            printf("%-15s: pc(%d) taken, %d squashed\n", apex_stage_titles[record->stage],
+                   record->pc, record->aux);
+            break;
+        }
+        }
+    }
+
+    if (log && log->cycle)
+    {
+        /* Retire or flush whatever is still in flight */
+        printf("C\t1\n");
+        log->cycle++;
+        konata_end_cycle(log);
+    }
+    free(log);
+
+    munmap(map, map_size);
+    return 0;
+}
@@ -0,0 +1,692 @@
+/*
+ * apex_wide.c
+ * Contains the N-wide in-order superscalar APEX pipeline, selected with
+ * config.width > 1
+ *
+ * Every stage holds a group of up to width instructions in program order.
+ * Decode issues the longest prefix of its group that has its operands and
+ * fits the register file read ports, the single data memory port and the
+ * MUL, DIV and AGU units. Execute holds a group until its slowest operation
+ * has completed, and resolves a branch, always the last instruction of its
+ * group, once the flags it tests are computed.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+static int
+get_code_memory_index_from_pc(const int pc)
+{
+    return (pc - 4000) / 4;
+}
+
+/* Reports every instruction of group to the debug output and the trace */
+static void
+group_event(APEX_CPU *cpu, int stage_id, const APEX_StageGroup *group)
+{
+    int i;
+
+    for (i = 0; i < group->count; ++i)
+    {
+        APEX_stage_event(cpu, stage_id, &group->slot[i]);
+    }
+}
+
+/* Removes the oldest n instructions of group */
+static void
+group_remove(APEX_StageGroup *group, int n)
+{
+    group->count -= n;
+    memmove(&group->slot[0], &group->slot[n], group->count * sizeof(CPU_Stage));
+}
+
+/* Returns TRUE if stage writes reg in writeback */
+static int
+writes_register(const CPU_Stage *stage, int reg)
+{
+    const APEX_Instruction *ins = stage->insn;
+    int dst = apex_op_table[ins->opcode].dst;
+
+    return ((dst & DST_RD) && ins->rd == reg) || ((dst & DST_RS1_POST) && ins->rs1 == reg) ||
+           ((dst & DST_RS2_POST) && ins->rs2 == reg);
+}
+
+/* Finds the value of reg written by the in-flight instruction seq in group,
+ * returns FALSE if it is not there or has not computed it */
+static int
+group_result(const APEX_StageGroup *group, int reg, long seq, int loaded, int *value,
+             int *found)
+{
+    int i;
+
+    for (i = 0; i < group->count; ++i)
+    {
+        if (group->slot[i].seq == seq)
+        {
+            *found = TRUE;
+            return APEX_stage_result(&group->slot[i], reg, loaded, value);
+        }
+    }
+    return FALSE;
+}
+
+/* Reads a source register in decode and returns the BYPASS_* path the value
+ * came from, or BYPASS_STALL. Execute is empty whenever decode issues, so a
+ * producer is in the Memory or Writeback group, or earlier in the group
+ * being issued. */
+static int
+read_source_register(const APEX_CPU *cpu, int reg, int *value)
+{
+    long producer = cpu->reg_producer[reg];
+    int found = FALSE;
+
+    if (producer == 0)
+    {
+        *value = cpu->regs[reg];
+        return BYPASS_REGISTER_FILE;
+    }
+    if (!cpu->config.forwarding)
+    {
+        return BYPASS_STALL;
+    }
+    if (group_result(&cpu->wide[STAGE_MEMORY], reg, producer, FALSE, value, &found))
+    {
+        return BYPASS_EX_MEM;
+    }
+    if (!found && group_result(&cpu->wide[STAGE_WRITEBACK], reg, producer, TRUE, value, &found))
+    {
+        return BYPASS_MEM_WB;
+    }
+    return BYPASS_STALL;
+}
+
+/* Charges the cycle about to be simulated to the oldest instruction in the
+ * pipeline, or to the fetch PC when the pipeline is empty */
+static void
+profile_cycle(APEX_CPU *cpu)
+{
+    APEX_PcProfile *entry = NULL;
+    int i;
+
+    for (i = STAGE_WRITEBACK; i >= STAGE_FETCH && !entry; --i)
+    {
+        if (cpu->wide[i].count)
+        {
+            entry = APEX_profile_entry(cpu, cpu->wide[i].slot[0].pc);
+        }
+    }
+    if (!entry && cpu->fetch.has_insn)
+    {
+        entry = APEX_profile_entry(cpu, cpu->pc);
+    }
+    if (entry)
+    {
+        APEX_profile_count(cpu, &entry->cycles);
+    }
+}
+
+/*
+ * Fetch Stage of the superscalar pipeline
+ *
+ * cpu->fetch.has_insn enables fetching. An empty group is refilled with up
+ * to width sequential instructions, up to HALT or a branch predicted taken,
+ * which then move to Decode as it frees slots. Also the front end of the
+ * out-of-order core.
+ */
+void
+APEX_wide_fetch(APEX_CPU *cpu)
+{
+    APEX_StageGroup *fetch = &cpu->wide[STAGE_FETCH];
+    APEX_StageGroup *decode = &cpu->wide[STAGE_DECODE];
+    int n, i;
+
+    if (!cpu->fetch.has_insn && fetch->count == 0)
+    {
+        return;
+    }
+
+    /* This fetches new branch target instructions from next cycle */
+    if (cpu->fetch_from_next_cycle == TRUE)
+    {
+        cpu->fetch_from_next_cycle = FALSE;
+        cpu->counters.fetch_bubbles++;
+        return;
+    }
+
+    if (fetch->count == 0)
+    {
+        int latency = 1;
+
+        /* Nothing is fetched outside code memory, see APEX_fetch_faulted */
+        while (fetch->count < cpu->config.width && APEX_code_index(cpu, cpu->pc) >= 0)
+        {
+            CPU_Stage *stage = &fetch->slot[fetch->count++];
+
+            memset(stage, 0, sizeof(CPU_Stage));
+            stage->pc = cpu->pc;
+            stage->insn = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
+            stage->has_insn = TRUE;
+            stage->seq = ++cpu->insn_fetched;
+            stage->predicted_pc = cpu->config.predictor == PREDICTOR_NONE
+                                      ? cpu->pc + 4
+                                      : APEX_bp_predict(cpu, cpu->pc, stage->insn);
+            if (cpu->config.icache.size)
+            {
+                n = APEX_fetch_latency(cpu, cpu->pc);
+                latency = n > latency ? n : latency;
+            }
+            cpu->pc = stage->predicted_pc;
+
+            /* Stop fetching new instructions if HALT is fetched */
+            if (stage->insn->opcode == OPCODE_HALT)
+            {
+                cpu->fetch.has_insn = FALSE;
+                break;
+            }
+            if (stage->predicted_pc != stage->pc + 4)
+            {
+                break;
+            }
+        }
+        cpu->fetch_cycles_left = latency - 1;
+    }
+
+    /* Wait for an instruction cache miss */
+    if (cpu->fetch_cycles_left > 0)
+    {
+        cpu->fetch_cycles_left--;
+        APEX_count_stall(cpu, STALL_ICACHE, STAGE_FETCH, &fetch->slot[0]);
+        group_event(cpu, STAGE_FETCH, fetch);
+        return;
+    }
+
+    group_event(cpu, STAGE_FETCH, fetch);
+
+    /* Decode keeps the instructions it has not issued */
+    n = cpu->config.width - decode->count;
+    n = n < fetch->count ? n : fetch->count;
+    if (APEX_OBSERVING(cpu, APEX_EVENT_FETCH))
+    {
+        for (i = 0; i < n; ++i)
+        {
+            APEX_observer_event(cpu, APEX_EVENT_FETCH, STAGE_FETCH, &fetch->slot[i], 0, 0, 0);
+        }
+    }
+    memcpy(&decode->slot[decode->count], &fetch->slot[0], n * sizeof(CPU_Stage));
+    decode->count += n;
+    group_remove(fetch, n);
+}
+
+/* Flushes the instructions fetched after the branch resolved in Execute and
+ * redirects fetch to target */
+static void
+redirect_fetch(APEX_CPU *cpu, const CPU_Stage *branch, int target)
+{
+    int squashed = cpu->wide[STAGE_DECODE].count + cpu->wide[STAGE_FETCH].count;
+    APEX_PcProfile *entry = APEX_profile_entry(cpu, branch->pc);
+
+    cpu->counters.flushed += squashed;
+    if (entry)
+    {
+        /* The squashed instructions and the skipped fetch */
+        entry->flushes += squashed + 1;
+    }
+    if (cpu->trace)
+    {
+        APEX_trace_event(cpu, STAGE_EXECUTE, TRACE_FLUSH, branch, squashed);
+    }
+    APEX_OBSERVE(cpu, APEX_EVENT_FLUSH, STAGE_EXECUTE, branch, squashed, target, 0);
+
+    cpu->pc = target;
+    cpu->fetch_from_next_cycle = TRUE;
+    cpu->wide[STAGE_DECODE].count = 0;
+    cpu->wide[STAGE_FETCH].count = 0;
+    cpu->fetch_cycles_left = 0;
+    cpu->fetch.has_insn = TRUE;
+}
+
+/*
+ * Decode Stage of the superscalar pipeline
+ *
+ * Issues the oldest instructions of the group to an empty Execute stage, in
+ * order, until one misses an operand or a resource. An instruction reading
+ * the result of an older one in the same group waits, as that result is
+ * only computed in Execute.
+ */
+static void
+wide_decode(APEX_CPU *cpu)
+{
+    APEX_StageGroup *decode = &cpu->wide[STAGE_DECODE];
+    APEX_StageGroup *execute = &cpu->wide[STAGE_EXECUTE];
+    int ports = cpu->config.rf_read_ports ? cpu->config.rf_read_ports : 2 * cpu->config.width;
+    int units = 0;
+    int cause = -1;
+    int n;
+
+    if (decode->count == 0)
+    {
+        return;
+    }
+    if (execute->count)
+    {
+        APEX_count_stall(cpu, STALL_EXECUTE_BUSY, STAGE_DECODE, &decode->slot[0]);
+        group_event(cpu, STAGE_DECODE, decode);
+        return;
+    }
+
+    for (n = 0; n < decode->count; ++n)
+    {
+        CPU_Stage *stage = &decode->slot[n];
+        const APEX_Instruction *ins = stage->insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+        int ready = TRUE;
+        int reads = 0;
+
+        /* One data memory port, and a single MUL, DIV and AGU */
+        if (op->unit != FU_ALU && (units & (1 << op->unit)))
+        {
+            cause = STALL_STRUCTURAL;
+            break;
+        }
+
+        if (op->src & SRC_RS1)
+        {
+            stage->rs1_path = read_source_register(cpu, ins->rs1, &stage->rs1_value);
+            if (stage->rs1_path == BYPASS_STALL)
+            {
+                if (op->mem == MEM_STORE && cpu->config.forwarding)
+                {
+                    /* Store data is not needed before the Memory stage */
+                    stage->rs1_path = BYPASS_STORE_DATA;
+                }
+                else
+                {
+                    ready = FALSE;
+                }
+            }
+            reads += stage->rs1_path == BYPASS_REGISTER_FILE;
+        }
+        if (op->src & SRC_RS2)
+        {
+            stage->rs2_path = read_source_register(cpu, ins->rs2, &stage->rs2_value);
+            if (stage->rs2_path == BYPASS_STALL)
+            {
+                ready = FALSE;
+            }
+            reads += stage->rs2_path == BYPASS_REGISTER_FILE;
+        }
+        if (!ready)
+        {
+            cause = cpu->config.forwarding ? STALL_LOAD_USE : STALL_RAW;
+            break;
+        }
+        if (reads > ports)
+        {
+            cause = STALL_STRUCTURAL;
+            break;
+        }
+        ports -= reads;
+        units |= 1 << op->unit;
+
+        if (op->src & SRC_RS1)
+        {
+            cpu->counters.bypass[stage->rs1_path]++;
+        }
+        if (op->src & SRC_RS2)
+        {
+            cpu->counters.bypass[stage->rs2_path]++;
+        }
+
+        /* Younger readers, in this group too, now depend on it */
+        if (op->dst & DST_RD)
+        {
+            cpu->reg_producer[ins->rd] = stage->seq;
+        }
+        if (op->dst & DST_RS1_POST)
+        {
+            cpu->reg_producer[ins->rs1] = stage->seq;
+        }
+        if (op->dst & DST_RS2_POST)
+        {
+            cpu->reg_producer[ins->rs2] = stage->seq;
+        }
+        execute->slot[n] = *stage;
+        APEX_OBSERVE(cpu, APEX_EVENT_ISSUE, STAGE_DECODE, &execute->slot[n], 0, 0, 0);
+
+        /* A branch ends its group */
+        if (op->ctrl != CTRL_NONE)
+        {
+            n++;
+            break;
+        }
+    }
+
+    if (cause >= 0)
+    {
+        APEX_count_stall(cpu, cause, STAGE_DECODE, &decode->slot[n]);
+    }
+    group_event(cpu, STAGE_DECODE, decode);
+
+    if (n > 0)
+    {
+        execute->count = n;
+        execute->executed = FALSE;
+        cpu->counters.issued[n]++;
+        group_remove(decode, n);
+    }
+}
+
+/*
+ * Execute Stage of the superscalar pipeline
+ *
+ * Computes the whole group the cycle it arrives, in program order, and holds
+ * it until the slowest operation has taken its unit latency. The units are
+ * not pipelined across groups.
+ */
+static void
+wide_execute(APEX_CPU *cpu)
+{
+    APEX_StageGroup *execute = &cpu->wide[STAGE_EXECUTE];
+    const CPU_Stage *last;
+    const APEX_OpInfo *op;
+    int done = 0; /* Last cycle of the slowest operation */
+    int busy = 0;
+    int i;
+
+    if (execute->count == 0)
+    {
+        return;
+    }
+
+    if (!execute->executed)
+    {
+        execute->flags = (cpu->zero_flag ? FLAG_Z : 0) | (cpu->positive_flag ? FLAG_P : 0) |
+                         (cpu->negative_flag ? FLAG_N : 0);
+        for (i = 0; i < execute->count; ++i)
+        {
+            CPU_Stage *stage = &execute->slot[i];
+
+            op = &apex_op_table[stage->insn->opcode];
+            if (op->exec)
+            {
+                op->exec(stage);
+            }
+            if (op->flags)
+            {
+                APEX_update_flags(cpu, op->flags, stage->result_buffer);
+            }
+            stage->complete_cycle = cpu->clock + cpu->config.fu[op->unit].latency - 1;
+            cpu->counters.fu_issued[op->unit]++;
+        }
+        execute->executed = TRUE;
+    }
+
+    for (i = 0; i < execute->count; ++i)
+    {
+        op = &apex_op_table[execute->slot[i].insn->opcode];
+        if (execute->slot[i].complete_cycle >= cpu->clock)
+        {
+            busy |= 1 << op->unit;
+        }
+        if (execute->slot[i].complete_cycle > done)
+        {
+            done = execute->slot[i].complete_cycle;
+        }
+    }
+    for (i = 0; busy; ++i, busy >>= 1)
+    {
+        cpu->counters.fu_busy[i] += busy & 1;
+    }
+
+    /* The branch resolves in the cycle every older operation of its group,
+     * and so the flags it tests, has completed, not again while Memory
+     * holds the group */
+    last = &execute->slot[execute->count - 1];
+    op = &apex_op_table[last->insn->opcode];
+    if (op->ctrl != CTRL_NONE && done == cpu->clock)
+    {
+        int next_pc = APEX_resolve_branch(cpu, last, op, APEX_branch_taken(cpu, op));
+
+        if (next_pc != last->predicted_pc)
+        {
+            redirect_fetch(cpu, last, next_pc);
+        }
+    }
+
+    if (done <= cpu->clock)
+    {
+        if (cpu->wide[STAGE_MEMORY].count)
+        {
+            APEX_count_stall(cpu, STALL_MEMORY_BUSY, STAGE_EXECUTE, &execute->slot[0]);
+        }
+        else
+        {
+            cpu->wide[STAGE_MEMORY] = *execute;
+            execute->count = 0;
+            group_event(cpu, STAGE_EXECUTE, &cpu->wide[STAGE_MEMORY]);
+            return;
+        }
+    }
+    group_event(cpu, STAGE_EXECUTE, execute);
+}
+
+/* Sets the flags as they were after the instructions of group older than
+ * slot n, undoing the updates of the younger ones */
+static void
+restore_flags(APEX_CPU *cpu, const APEX_StageGroup *group, int n)
+{
+    int i;
+
+    cpu->zero_flag = (group->flags & FLAG_Z) != 0;
+    cpu->positive_flag = (group->flags & FLAG_P) != 0;
+    cpu->negative_flag = (group->flags & FLAG_N) != 0;
+    for (i = 0; i < n; ++i)
+    {
+        int mask = apex_op_table[group->slot[i].insn->opcode].flags;
+
+        if (mask)
+        {
+            APEX_update_flags(cpu, mask, group->slot[i].result_buffer);
+        }
+    }
+}
+
+/*
+ * Memory Stage of the superscalar pipeline
+ *
+ * A group has at most one LOAD or STORE, which holds the group for its data
+ * memory access.
+ */
+static void
+wide_memory(APEX_CPU *cpu)
+{
+    APEX_StageGroup *memory = &cpu->wide[STAGE_MEMORY];
+    int i, m;
+
+    if (memory->count == 0)
+    {
+        return;
+    }
+
+    for (m = 0; m < memory->count; ++m)
+    {
+        if (apex_op_table[memory->slot[m].insn->opcode].mem != MEM_NONE)
+        {
+            break;
+        }
+    }
+
+    if (m < memory->count)
+    {
+        CPU_Stage *stage = &memory->slot[m];
+        const APEX_Instruction *ins = stage->insn;
+        int mem = apex_op_table[ins->opcode].mem;
+
+        if (cpu->memory_cycles_left == 0)
+        {
+            cpu->memory_cycles_left = APEX_data_access_latency(cpu, stage->memory_address,
+                                                               mem == MEM_STORE);
+        }
+        if (--cpu->memory_cycles_left > 0)
+        {
+            APEX_count_stall(cpu, STALL_MEMORY_LATENCY, STAGE_MEMORY, stage);
+            group_event(cpu, STAGE_MEMORY, memory);
+            return;
+        }
+
+        if (!APEX_mem_in_range(cpu, stage->memory_address))
+        {
+            /* Stop the pipeline with the faulting instruction in Memory */
+            cpu->mem_fault = TRUE;
+            cpu->mem_fault_pc = stage->pc;
+            cpu->mem_fault_address = stage->memory_address;
+
+            /* Younger instructions of the group were computed with it */
+            restore_flags(cpu, memory, m);
+            return;
+        }
+
+        if (mem == MEM_LOAD)
+        {
+            APEX_mem_read(cpu, stage->memory_address, &stage->result_buffer);
+            APEX_OBSERVE(cpu, APEX_EVENT_MEM_ACCESS, STAGE_MEMORY, stage, FALSE, stage->memory_address,
+                         stage->result_buffer);
+        }
+        else
+        {
+            if (stage->rs1_path == BYPASS_STORE_DATA)
+            {
+                /* Older groups have retired, the data comes from the
+                 * register file or from the group */
+                stage->rs1_value = cpu->regs[ins->rs1];
+                for (i = 0; i < m; ++i)
+                {
+                    if (writes_register(&memory->slot[i], ins->rs1))
+                    {
+                        APEX_stage_result(&memory->slot[i], ins->rs1, TRUE, &stage->rs1_value);
+                    }
+                }
+            }
+            APEX_mem_write(cpu, stage->memory_address, stage->rs1_value);
+            APEX_OBSERVE(cpu, APEX_EVENT_MEM_ACCESS, STAGE_MEMORY, stage, TRUE, stage->memory_address,
+                         stage->rs1_value);
+        }
+    }
+
+    /* Writeback retired its group earlier in this cycle */
+    cpu->wide[STAGE_WRITEBACK] = *memory;
+    memory->count = 0;
+    group_event(cpu, STAGE_MEMORY, &cpu->wide[STAGE_WRITEBACK]);
+}
+
+/* Writes a register in writeback, the register file is up to date once
+ * its youngest in-flight writer has written it */
+static void
+write_register(APEX_CPU *cpu, const CPU_Stage *stage, int reg, int value)
+{
+    cpu->regs[reg] = value;
+    if (cpu->reg_producer[reg] == stage->seq)
+    {
+        cpu->reg_producer[reg] = 0;
+    }
+}
+
+/*
+ * Writeback Stage of the superscalar pipeline, retires the group in
+ * program order
+ *
+ * Returns TRUE once HALT has retired
+ */
+static int
+wide_writeback(APEX_CPU *cpu)
+{
+    APEX_StageGroup *writeback = &cpu->wide[STAGE_WRITEBACK];
+    int i;
+
+    for (i = 0; i < writeback->count; ++i)
+    {
+        const CPU_Stage *stage = &writeback->slot[i];
+        const APEX_Instruction *ins = stage->insn;
+        const APEX_OpInfo *op = &apex_op_table[ins->opcode];
+
+        if (op->dst & DST_RD)
+        {
+            write_register(cpu, stage, ins->rd, stage->result_buffer);
+        }
+        if (op->dst & DST_RS1_POST)
+        {
+            write_register(cpu, stage, ins->rs1, stage->rs1_value + 4);
+        }
+        if (op->dst & DST_RS2_POST)
+        {
+            write_register(cpu, stage, ins->rs2, stage->rs2_value + 4);
+        }
+
+        cpu->insn_completed++;
+        cpu->counters.retired++;
+        cpu->counters.retired_by_opcode[ins->opcode]++;
+        if (cpu->profile)
+        {
+            APEX_profile_entry(cpu, stage->pc)->executions++;
+        }
+        APEX_OBSERVE(cpu, APEX_EVENT_RETIRE, STAGE_WRITEBACK, stage, 0, 0, 0);
+        APEX_stage_event(cpu, STAGE_WRITEBACK, stage);
+
+        if (ins->opcode == OPCODE_HALT)
+        {
+            writeback->count = 0;
+            return TRUE;
+        }
+    }
+    writeback->count = 0;
+    return FALSE;
+}
+
+/*
+ * Simulates one clock cycle of the superscalar pipeline, stages are called
+ * in reverse order as in the scalar one.
+ *
+ * Returns TRUE once HALT has retired or on a data memory or fetch fault.
+ */
+int
+APEX_wide_cycle(APEX_CPU *cpu)
+{
+    int i;
+
+    /* Occupancy is sampled as the cycle starts */
+    cpu->counters.occupancy[STAGE_FETCH] += cpu->fetch.has_insn || cpu->wide[STAGE_FETCH].count;
+    for (i = STAGE_DECODE; i < NUM_STAGES; ++i)
+    {
+        cpu->counters.occupancy[i] += cpu->wide[i].count > 0;
+    }
+    if (cpu->profile)
+    {
+        profile_cycle(cpu);
+    }
+
+    if (wide_writeback(cpu))
+    {
+        return TRUE;
+    }
+    wide_memory(cpu);
+    if (cpu->mem_fault)
+    {
+        return TRUE;
+    }
+    wide_execute(cpu);
+    wide_decode(cpu);
+    APEX_wide_fetch(cpu);
+    for (i = STAGE_FETCH; i < NUM_STAGES; ++i)
+    {
+        if (cpu->wide[i].count)
+        {
+            return FALSE;
+        }
+    }
+    return APEX_fetch_faulted(cpu, TRUE);
+}
@@ -7,366 +7,737 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
-#include <assert.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Mnemonics indexed by numeric opcode, used only when printing instructions
  */
-static int
-get_num_from_string(const char *buffer)
+static const char *const opcode_strs[] = {
+    [OPCODE_ADD] = "ADD",
+    [OPCODE_SUB] = "SUB",
+    [OPCODE_MUL] = "MUL",
+    [OPCODE_DIV] = "DIV",
+    [OPCODE_AND] = "AND",
+    [OPCODE_OR] = "OR",
+    [OPCODE_XOR] = "EX-OR",
+    [OPCODE_MOVC] = "MOVC",
+    [OPCODE_LOAD] = "LOAD",
+    [OPCODE_STORE] = "STORE",
+    [OPCODE_BZ] = "BZ",
+    [OPCODE_BNZ] = "BNZ",
+    [OPCODE_HALT] = "HALT",
+    [OPCODE_ADDL] = "ADDL",
+    [OPCODE_SUBL] = "SUBL",
+    [OPCODE_LOADP] = "LOADP",
+    [OPCODE_STOREP] = "STOREP",
+    [OPCODE_CML] = "CML",
+    [OPCODE_CMP] = "CMP",
+    [OPCODE_BP] = "BP",
+    [OPCODE_BNP] = "BNP",
+    [OPCODE_BN] = "BN",
+    [OPCODE_BNN] = "BNN",
+    [OPCODE_JUMP] = "JUMP",
+    [OPCODE_JALR] = "JALR",
+    [OPCODE_NOP] = "NOP",
+};
+
+const char *
+get_opcode_str(int opcode)
 {
-    char str[16];
-    int i, j = 0;
-
-    for (i = 1; buffer[i] != '\0'; ++i)
+    if (opcode < 0 || opcode >= (int)(sizeof(opcode_strs) / sizeof(opcode_strs[0])) || !opcode_strs[opcode])
     {
-        str[j] = buffer[i];
-        j++;
+        return "???";
     }
-    str[j] = '\0';
-
-    return atoi(str);
+    return opcode_strs[opcode];
 }
 
-/*
- * This function sets the numeric opcode to an instruction based on string value
- *
- * Note : you can edit this function to add new instructions
- */
-static int
-set_opcode_str(const char *opcode_str)
+/* Prints ins in assembly syntax, as shown in the pipeline display */
+void
+print_instruction(FILE *out, const APEX_Instruction *ins)
 {
-    if (strcmp(opcode_str, "ADD") == 0)
+    switch (ins->opcode)
     {
-        return OPCODE_ADD;
-    }
-
-    if (strcmp(opcode_str, "SUB") == 0)
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
     {
-        return OPCODE_SUB;
+        fprintf(out, "%s,R%d,R%d,R%d ", get_opcode_str(ins->opcode), ins->rd, ins->rs1,
+                     ins->rs2);
+        break;
     }
-    if (strcmp(opcode_str, "ADDL") == 0)
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_JALR:
     {
-        return OPCODE_ADDL;
+        fprintf(out, "%s,R%d,R%d,#%d ", get_opcode_str(ins->opcode), ins->rd, ins->rs1,
+                     ins->imm);
+        break;
     }
 
-    if (strcmp(opcode_str, "SUBL") == 0)
+    case OPCODE_MOVC:
     {
-        return OPCODE_SUBL;
+        fprintf(out, "%s,R%d,#%d ", get_opcode_str(ins->opcode), ins->rd, ins->imm);
+        break;
     }
 
-    if (strcmp(opcode_str, "MUL") == 0)
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
     {
-        return OPCODE_MUL;
+        fprintf(out, "%s,R%d,R%d,#%d ", get_opcode_str(ins->opcode), ins->rd, ins->rs1,
+                     ins->imm);
+        break;
     }
 
-    if (strcmp(opcode_str, "AND") == 0)
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
     {
-        return OPCODE_AND;
+        fprintf(out, "%s,R%d,R%d,#%d ", get_opcode_str(ins->opcode), ins->rs1, ins->rs2,
+                     ins->imm);
+        break;
     }
-
-    if (strcmp(opcode_str, "OR") == 0)
+    case OPCODE_CML:
+    case OPCODE_JUMP:
     {
-        return OPCODE_OR;
+        fprintf(out, "%s,R%d,#%d ", get_opcode_str(ins->opcode), ins->rs1, ins->imm);
+        break;
     }
-
-    if (strcmp(opcode_str, "EX-OR") == 0)
+    case OPCODE_CMP:
     {
-        return OPCODE_XOR;
+        fprintf(out, "%s,R%d,R%d ", get_opcode_str(ins->opcode), ins->rs1, ins->rs2);
+        break;
     }
 
-    if (strcmp(opcode_str, "MOVC") == 0)
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    case OPCODE_BN:
+    case OPCODE_BNN:
     {
-        return OPCODE_MOVC;
+        fprintf(out, "%s,#%d ", get_opcode_str(ins->opcode), ins->imm);
+        break;
     }
 
-    if (strcmp(opcode_str, "LOAD") == 0)
+    case OPCODE_HALT:
+    case OPCODE_NOP:
     {
-        return OPCODE_LOAD;
+        fprintf(out, "%s ", get_opcode_str(ins->opcode));
+        break;
     }
-
-    if (strcmp(opcode_str, "STORE") == 0)
-    {
-        return OPCODE_STORE;
     }
+}
 
-    if (strcmp(opcode_str, "LOADP") == 0)
-    {
-        return OPCODE_LOADP;
-    }
+/* Largest number of diagnostics reported for one file before giving up */
+#define MAX_PARSE_ERRORS 20
 
-    if (strcmp(opcode_str, "STOREP") == 0)
-    {
-        return OPCODE_STOREP;
-    }
+/* Mnemonic lookup table. The slot of a mnemonic is given by mnemonic_hash,
+ * which is collision free over the APEX mnemonics, so a lookup is one hash
+ * and one compare. */
+typedef struct APEX_Mnemonic
+{
+    const char *name;
+    int opcode;
+} APEX_Mnemonic;
+
+#define MNEMONIC_TABLE_SIZE 64
+
+static const APEX_Mnemonic mnemonic_table[MNEMONIC_TABLE_SIZE] = {
+    [1] = {"CMP", OPCODE_CMP},
+    [2] = {"ADDL", OPCODE_ADDL},
+    [7] = {"BNP", OPCODE_BNP},
+    [8] = {"LOAD", OPCODE_LOAD},
+    [9] = {"BNZ", OPCODE_BNZ},
+    [10] = {"JALR", OPCODE_JALR},
+    [12] = {"STORE", OPCODE_STORE},
+    [13] = {"CML", OPCODE_CML},
+    [16] = {"JUMP", OPCODE_JUMP},
+    [22] = {"BP", OPCODE_BP},
+    [25] = {"ADD", OPCODE_ADD},
+    [26] = {"OR", OPCODE_OR},
+    [28] = {"STOREP", OPCODE_STOREP},
+    [32] = {"HALT", OPCODE_HALT},
+    [33] = {"MUL", OPCODE_MUL},
+    [37] = {"LOADP", OPCODE_LOADP},
+    [39] = {"NOP", OPCODE_NOP},
+    [40] = {"BZ", OPCODE_BZ},
+    [41] = {"AND", OPCODE_AND},
+    [43] = {"SUB", OPCODE_SUB},
+    [44] = {"BN", OPCODE_BN},
+    [45] = {"BNN", OPCODE_BNN},
+    [46] = {"SUBL", OPCODE_SUBL},
+    [49] = {"DIV", OPCODE_DIV},
+    [57] = {"EX-OR", OPCODE_XOR},
+    [61] = {"MOVC", OPCODE_MOVC},
+};
 
-    if (strcmp(opcode_str, "CML") == 0)
-    {
-        return OPCODE_CML;
-    }
+/*
+ * Operands of each instruction in source order:
+ *  'd' - rd, '1' - rs1, '2' - rs2 (registers, Rn)
+ *  'i' - imm (literal, #n)
+ *
+ * Note : you can edit this table to add new instructions
+ */
+static const char *const operand_formats[NUM_OPCODES] = {
+    [OPCODE_ADD] = "d12",
+    [OPCODE_SUB] = "d12",
+    [OPCODE_MUL] = "d12",
+    [OPCODE_DIV] = "d12",
+    [OPCODE_AND] = "d12",
+    [OPCODE_OR] = "d12",
+    [OPCODE_XOR] = "d12",
+    [OPCODE_ADDL] = "d1i",
+    [OPCODE_SUBL] = "d1i",
+    [OPCODE_MOVC] = "di",
+    [OPCODE_LOAD] = "d1i",
+    [OPCODE_LOADP] = "d1i",
+    [OPCODE_STORE] = "12i",
+    [OPCODE_STOREP] = "12i",
+    [OPCODE_CMP] = "12",
+    [OPCODE_CML] = "1i",
+    [OPCODE_JUMP] = "1i",
+    [OPCODE_JALR] = "d1i",
+    [OPCODE_BZ] = "i",
+    [OPCODE_BNZ] = "i",
+    [OPCODE_BP] = "i",
+    [OPCODE_BNP] = "i",
+    [OPCODE_BN] = "i",
+    [OPCODE_BNN] = "i",
+    [OPCODE_HALT] = "",
+    [OPCODE_NOP] = "",
+};
+
+/* Cursor over the program text */
+typedef struct APEX_Parser
+{
+    const char *name;  /* File name used in diagnostics */
+    const char *pos;   /* Next character */
+    const char *end;
+    const char *line_start;
+    int line;
+    int num_errors;
+    FILE *diag;        /* Diagnostics sink, NULL to stay silent */
+} APEX_Parser;
+
+static unsigned int
+mnemonic_hash(const char *str, size_t len)
+{
+    return (unsigned int)(len + 2 * (unsigned char)str[0] + 13 * (unsigned char)str[len - 1] +
+                          8 * (unsigned char)str[1]) %
+           MNEMONIC_TABLE_SIZE;
+}
+
+/* Returns the opcode of a mnemonic, -1 if it is not an APEX instruction */
+static int
+lookup_mnemonic(const char *str, size_t len)
+{
+    const APEX_Mnemonic *entry;
 
-    if (strcmp(opcode_str, "CMP") == 0)
+    if (len < 2)
     {
-        return OPCODE_CMP;
+        return -1;
     }
-    if (strcmp(opcode_str, "BZ") == 0)
+    entry = &mnemonic_table[mnemonic_hash(str, len)];
+    if (!entry->name || strncmp(entry->name, str, len) != 0 || entry->name[len] != '\0')
     {
-        return OPCODE_BZ;
+        return -1;
     }
+    return entry->opcode;
+}
 
-    if (strcmp(opcode_str, "BNZ") == 0)
+/* Reports an error at column of at on the current line */
+static void
+parse_error(APEX_Parser *parser, const char *at, const char *fmt, ...)
+{
+    va_list args;
+
+    parser->num_errors++;
+    if (!parser->diag || parser->num_errors > MAX_PARSE_ERRORS)
     {
-        return OPCODE_BNZ;
+        return;
     }
-    if (strcmp(opcode_str, "BP") == 0)
+    fprintf(parser->diag, "%s:%d:%d: error: ", parser->name, parser->line,
+            (int)(at - parser->line_start) + 1);
+    va_start(args, fmt);
+    vfprintf(parser->diag, fmt, args);
+    va_end(args);
+    fprintf(parser->diag, "\n");
+}
+
+static int
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void
+skip_blanks(APEX_Parser *parser)
+{
+    while (parser->pos < parser->end && is_blank(*parser->pos))
     {
-        return OPCODE_BP;
+        parser->pos++;
     }
+}
+
+/* Length of the token at the cursor, up to a blank, comma or end of line */
+static int
+token_length(const APEX_Parser *parser)
+{
+    const char *p = parser->pos;
 
-    if (strcmp(opcode_str, "BNP") == 0)
+    while (p < parser->end && !is_blank(*p) && *p != ',' && *p != '\n')
     {
-        return OPCODE_BNP;
+        p++;
     }
-    if (strcmp(opcode_str, "BN") == 0)
+    return (int)(p - parser->pos);
+}
+
+/*
+ * Parses one operand with the given prefix ('R' or '#') into *value.
+ *
+ * Returns 0 on success, -1 after reporting an error.
+ */
+static int
+parse_operand(APEX_Parser *parser, char prefix, int *value)
+{
+    const char *start = parser->pos;
+    const char *p = start;
+    long long number = 0;
+    int negative = FALSE;
+    int len = token_length(parser);
+
+    if (len == 0)
     {
-        return OPCODE_BN;
+        parse_error(parser, start, prefix == 'R' ? "expected register" : "expected literal");
+        return -1;
     }
-
-    if (strcmp(opcode_str, "BNN") == 0)
+    if (*p != prefix && !(prefix == 'R' && *p == 'r'))
     {
-        return OPCODE_BNN;
+        parse_error(parser, start, "expected %s, found '%.*s'",
+                    prefix == 'R' ? "register" : "literal", len, start);
+        return -1;
     }
-    if (strcmp(opcode_str, "JUMP") == 0)
+    p++;
+    if (prefix == '#' && p < start + len && (*p == '-' || *p == '+'))
     {
-        return OPCODE_JUMP;
+        negative = (*p == '-');
+        p++;
     }
-    if (strcmp(opcode_str, "JALR") == 0)
+    if (p == start + len)
     {
-        return OPCODE_JALR;
+        parse_error(parser, start, "missing number in '%.*s'", len, start);
+        return -1;
     }
-
-    if (strncmp(opcode_str, "HALT", 1) == 0)
+    for (; p < start + len; ++p)
     {
-        return OPCODE_HALT;
+        if (*p < '0' || *p > '9')
+        {
+            parse_error(parser, start, "invalid number '%.*s'", len, start);
+            return -1;
+        }
+        number = number * 10 + (*p - '0');
+        if (number > 0x7fffffffLL + negative)
+        {
+            parse_error(parser, start, "number out of range '%.*s'", len, start);
+            return -1;
+        }
     }
-
-    if (strncmp(opcode_str, "NOP", 1) == 0)
+    if (prefix == 'R' && number >= REG_FILE_SIZE)
     {
-        return OPCODE_NOP;
+        parse_error(parser, start, "no such register '%.*s'", len, start);
+        return -1;
     }
 
-    assert(0 && "Invalid opcode");
+    *value = (int)(negative ? -number : number);
+    parser->pos += len;
     return 0;
 }
 
-static void
-split_opcode_from_insn_string(char *buffer, char tokens[2][128])
+/*
+ * Parses the instruction on the current line into ins. The cursor is left
+ * at the end of the line.
+ *
+ * Returns 0 on success, -1 after reporting an error.
+ */
+static int
+parse_instruction(APEX_Parser *parser, APEX_Instruction *ins)
 {
-    int token_num = 0;
-    char *token = strtok(buffer, " ");
-    // For HALT and NOP
-    char *only_opcodes;
+    const char *mnemonic = parser->pos;
+    int len = token_length(parser);
+    const char *format;
+    int i;
 
-    while (token != NULL)
+    memset(ins, 0, sizeof(*ins));
+    ins->opcode = lookup_mnemonic(mnemonic, len);
+    if (ins->opcode < 0 || !operand_formats[ins->opcode])
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, " ");
+        parse_error(parser, mnemonic, "unknown instruction '%.*s'", len, mnemonic);
+        return -1;
     }
+    parser->pos += len;
 
-    only_opcodes = tokens[0]; // copy opcode from tokens at 0 index
-
-    for (int i = 0; only_opcodes[i] != '\0'; i++)
+    format = operand_formats[ins->opcode];
+    for (i = 0; format[i] != '\0'; ++i)
     {
-        if (only_opcodes[i] == '\n')
+        int *field;
+
+        skip_blanks(parser);
+        if (i > 0)
+        {
+            if (parser->pos >= parser->end || *parser->pos != ',')
+            {
+                parse_error(parser, parser->pos, "expected ',' before operand %d", i + 1);
+                return -1;
+            }
+            parser->pos++;
+            skip_blanks(parser);
+        }
+
+        switch (format[i])
         {
-            only_opcodes[i] = '\0';
+        case 'd':
+            field = &ins->rd;
+            break;
+        case '1':
+            field = &ins->rs1;
+            break;
+        case '2':
+            field = &ins->rs2;
+            break;
+        default:
+            field = &ins->imm;
             break;
         }
+        if (parse_operand(parser, format[i] == 'i' ? '#' : 'R', field) != 0)
+        {
+            return -1;
+        }
     }
+
+    skip_blanks(parser);
+    if (parser->pos < parser->end && *parser->pos != '\n')
+    {
+        int len = token_length(parser);
+
+        parse_error(parser, parser->pos, "unexpected '%.*s' after instruction",
+                    len ? len : 1, parser->pos);
+        return -1;
+    }
+    return 0;
 }
 
 /*
- * This function is related to parsing input file
+ * Parses program text in a single pass, one instruction per line. Blank
+ * lines are skipped. Errors are reported to diag as file:line:column.
  *
- * Note : you can edit this function to add new instructions
+ * Returns the code memory, or NULL if the program is empty or has errors.
  */
-static void
-create_APEX_instruction(APEX_Instruction *ins, char *buffer)
+APEX_Instruction *
+parse_code_memory(const char *buffer, size_t length, const char *name, int *size,
+                  FILE *diag)
 {
-    int i, token_num = 0;
-    char tokens[6][128];
-    char top_level_tokens[2][128];
-
-    for (i = 0; i < 2; ++i)
-    {
-        strcpy(top_level_tokens[i], "");
-    }
+    APEX_Parser parser;
+    APEX_Instruction *code_memory = NULL;
+    int capacity = 0;
+    int count = 0;
+
+    parser.name = name;
+    parser.pos = buffer;
+    parser.end = buffer + length;
+    parser.line = 0;
+    parser.num_errors = 0;
+    parser.diag = diag;
+
+    while (parser.pos < parser.end)
+    {
+        const char *eol;
+
+        parser.line++;
+        parser.line_start = parser.pos;
+        eol = memchr(parser.pos, '\n', parser.end - parser.pos);
+        if (!eol)
+        {
+            eol = parser.end;
+        }
 
-    split_opcode_from_insn_string(buffer, top_level_tokens);
+        skip_blanks(&parser);
+        if (parser.pos < eol)
+        {
+            if (count == capacity)
+            {
+                APEX_Instruction *grown;
+
+                capacity = capacity ? capacity * 2 : 1024;
+                grown = realloc(code_memory, capacity * sizeof(APEX_Instruction));
+                if (!grown)
+                {
+                    free(code_memory);
+                    return NULL;
+                }
+                code_memory = grown;
+            }
+            if (parse_instruction(&parser, &code_memory[count]) == 0)
+            {
+                count++;
+            }
+        }
 
-    char *token = strtok(top_level_tokens[1], ",");
+        parser.pos = eol < parser.end ? eol + 1 : eol;
+    }
 
-    while (token != NULL)
+    *size = count;
+    if (parser.num_errors || !count)
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, ",");
+        if (diag && parser.num_errors > MAX_PARSE_ERRORS)
+        {
+            fprintf(diag, "%s: %d errors in total\n", name, parser.num_errors);
+        }
+        free(code_memory);
+        return NULL;
     }
+    return code_memory;
+}
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+/*
+ * Maps an assembly file and parses it with parse_code_memory, reporting
+ * errors to diag.
+ *
+ * Returns the code memory, or NULL if the file cannot be read, is empty or
+ * has errors.
+ */
+APEX_Instruction *
+create_code_memory(const char *filename, int *size, FILE *diag)
+{
+    APEX_Instruction *code_memory;
+    struct stat st;
+    void *text;
+    int fd;
 
-    switch (ins->opcode)
-    {
-    case OPCODE_ADD:
-    case OPCODE_SUB:
-    case OPCODE_MUL:
-    case OPCODE_AND:
-    case OPCODE_OR:
-    case OPCODE_XOR:
+    *size = 0;
+    if (!filename)
     {
-        ins->rd = get_num_from_string(tokens[0]);
-        ins->rs1 = get_num_from_string(tokens[1]);
-        ins->rs2 = get_num_from_string(tokens[2]);
-        break;
+        return NULL;
     }
 
-    case OPCODE_ADDL:
-    case OPCODE_SUBL:
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
     {
-        ins->rd = get_num_from_string(tokens[0]);
-        ins->rs1 = get_num_from_string(tokens[1]);
-        ins->imm = get_num_from_string(tokens[2]);
-        break;
+        return NULL;
     }
-
-    case OPCODE_MOVC:
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
     {
-        ins->rd = get_num_from_string(tokens[0]);
-        ins->imm = get_num_from_string(tokens[1]);
-        break;
+        close(fd);
+        return NULL;
     }
 
-    case OPCODE_LOAD:
-    case OPCODE_LOADP:
+    text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
     {
-        ins->rd = get_num_from_string(tokens[0]);
-        ins->rs1 = get_num_from_string(tokens[1]);
-        ins->imm = get_num_from_string(tokens[2]);
-        break;
+        return NULL;
     }
 
-    case OPCODE_STORE:
-    case OPCODE_STOREP:
+    code_memory = parse_code_memory(text, st.st_size, filename, size, diag);
+    munmap(text, st.st_size);
+    return code_memory;
+}
+
+/* Header of a binary program image written by apex-asm. It is followed
+ * directly by code_memory_size pre-decoded instructions. */
+#define CODE_IMAGE_MAGIC "APXB"
+#define CODE_IMAGE_VERSION 1
+
+typedef struct APEX_CodeImageHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t instruction_size;
+    int32_t code_memory_size;
+} APEX_CodeImageHeader;
+
+/*
+ * Writes code memory as a binary program image.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+write_code_image(const char *filename, const APEX_Instruction *code_memory, int size)
+{
+    APEX_CodeImageHeader header;
+    FILE *fp;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CODE_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = CODE_IMAGE_VERSION;
+    header.instruction_size = sizeof(APEX_Instruction);
+    header.code_memory_size = size;
+
+    fp = fopen(filename, "wb");
+    if (!fp)
     {
-        ins->rs1 = get_num_from_string(tokens[0]);
-        ins->rs2 = get_num_from_string(tokens[1]);
-        ins->imm = get_num_from_string(tokens[2]);
-        break;
+        return -1;
     }
-    case OPCODE_CMP:
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(code_memory, sizeof(APEX_Instruction), size, fp) == (size_t)size;
+    if (fclose(fp) != 0)
     {
-        ins->rs1 = get_num_from_string(tokens[0]);
-        ins->rs2 = get_num_from_string(tokens[1]);
-        break;
+        ok = FALSE;
+    }
+    return ok ? 0 : -1;
+}
+
+/*
+ * Checks code memory that was decoded elsewhere, a binary image or a
+ * checkpoint, before the pipeline indexes its tables and the register file
+ * with it. Every opcode must be an instruction of operand_formats and every
+ * register operand inside the register file.
+ *
+ * Returns 0 if it is valid, -1 after reporting the first bad instruction.
+ */
+int
+validate_code_memory(const APEX_Instruction *code_memory, int size, const char *name,
+                     FILE *diag)
+{
+    int i;
+
+    for (i = 0; i < size; ++i)
+    {
+        const APEX_Instruction *ins = &code_memory[i];
+
+        if (ins->opcode < 0 || ins->opcode >= NUM_OPCODES || !operand_formats[ins->opcode])
+        {
+            if (diag)
+            {
+                fprintf(diag, "%s: instruction %d: error: invalid opcode %d\n", name, i,
+                        ins->opcode);
+            }
+            return -1;
+        }
+        if (ins->rd < 0 || ins->rd >= REG_FILE_SIZE || ins->rs1 < 0 ||
+            ins->rs1 >= REG_FILE_SIZE || ins->rs2 < 0 || ins->rs2 >= REG_FILE_SIZE)
+        {
+            if (diag)
+            {
+                fprintf(diag, "%s: instruction %d: error: register out of range in %s,R%d,R%d,R%d\n",
+                        name, i, get_opcode_str(ins->opcode), ins->rd, ins->rs1, ins->rs2);
+            }
+            return -1;
+        }
     }
+    return 0;
+}
 
-    case OPCODE_CML:
-    case OPCODE_JUMP:
+/*
+ * Maps a binary program image, code memory is used in place from the
+ * mapping without any parsing.
+ *
+ * Returns NULL if filename is not a valid image.
+ */
+static APEX_Instruction *
+map_code_image(int fd, const char *filename, int *size, void **map, size_t *map_size,
+               FILE *diag)
+{
+    const APEX_CodeImageHeader *header;
+    struct stat st;
+    void *base;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header))
     {
-        ins->rs1 = get_num_from_string(tokens[0]);
-        ins->imm = get_num_from_string(tokens[1]);
-        break;
+        return NULL;
     }
-    case OPCODE_JALR:
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
     {
-        ins->rd = get_num_from_string(tokens[0]);
-        ins->rs1 = get_num_from_string(tokens[1]);
-        ins->imm = get_num_from_string(tokens[2]);
-        break;
+        return NULL;
     }
 
-    case OPCODE_BZ:
-    case OPCODE_BNZ:
-    case OPCODE_BP:
-    case OPCODE_BNP:
-    case OPCODE_BN:
-    case OPCODE_BNN:
+    header = base;
+    if (header->version != CODE_IMAGE_VERSION ||
+        header->instruction_size != sizeof(APEX_Instruction) ||
+        header->code_memory_size <= 0 ||
+        (size_t)st.st_size != sizeof(*header) + (size_t)header->code_memory_size * sizeof(APEX_Instruction))
     {
-        ins->imm = get_num_from_string(tokens[0]);
-        break;
+        if (diag)
+        {
+            fprintf(diag, "%s: error: not an image of this apex-asm version\n", filename);
+        }
+        munmap(base, st.st_size);
+        return NULL;
     }
-    case OPCODE_HALT:
-    case OPCODE_NOP:
+    if (validate_code_memory((const APEX_Instruction *)(header + 1), header->code_memory_size,
+                             filename, diag) != 0)
     {
-        break;
-    }
+        munmap(base, st.st_size);
+        return NULL;
     }
-    /* Fill in rest of the instructions accordingly */
+
+    *size = header->code_memory_size;
+    *map = base;
+    *map_size = st.st_size;
+    return (APEX_Instruction *)(header + 1);
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Loads code memory from either a binary program image or an assembly file,
+ * reporting why it is rejected to diag. *map is set to the mapping backing an
+ * image, or NULL if the code memory was allocated; release it with
+ * release_code_memory.
  */
 APEX_Instruction *
-create_code_memory(const char *filename, int *size)
+load_code_memory(const char *filename, int *size, void **map, size_t *map_size, FILE *diag)
 {
-    FILE *fp;
-    ssize_t nread;
-    size_t len = 0;
-    char *line = NULL;
-    int code_memory_size = 0;
-    int current_instruction = 0;
-    APEX_Instruction *code_memory;
+    char magic[4];
+    int fd;
 
+    *map = NULL;
+    *map_size = 0;
     if (!filename)
     {
         return NULL;
     }
 
-    fp = fopen(filename, "r");
-    if (!fp)
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
     {
         return NULL;
     }
-
-    while ((nread = getline(&line, &len, fp)) != -1)
-    {
-        code_memory_size++;
-    }
-    *size = code_memory_size;
-    if (!code_memory_size)
+    if (read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+        memcmp(magic, CODE_IMAGE_MAGIC, sizeof(magic)) == 0)
     {
-        fclose(fp);
-        return NULL;
+        APEX_Instruction *code_memory = map_code_image(fd, filename, size, map, map_size, diag);
+
+        close(fd);
+        return code_memory;
     }
+    close(fd);
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    return create_code_memory(filename, size, diag);
+}
+
+void
+release_code_memory(APEX_Instruction *code_memory, void *map, size_t map_size)
+{
+    if (map)
     {
-        fclose(fp);
-        return NULL;
+        munmap(map, map_size);
     }
-
-    rewind(fp);
-    while ((nread = getline(&line, &len, fp)) != -1)
+    else
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
-        current_instruction++;
+        free(code_memory);
     }
-
-    free(line);
-    fclose(fp);
-    return code_memory;
-}
\ No newline at end of file
+}
@@ -8,32 +8,243 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 
 #include "apex_cpu.h"
 
+/* End-of-run reports requested on the command line */
+typedef struct Reports
+{
+    const char *stats_file;
+    int stats_csv;
+    const char *profile_file;
+} Reports;
+
+/* Opens a report file, "-" is stdout */
+static FILE *
+open_report(const char *filename)
+{
+    FILE *fp = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", filename);
+    }
+    return fp;
+}
+
+static void
+close_report(FILE *fp)
+{
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+}
+
+/* Writes the requested reports and releases the cpu */
+static void
+stop_cpu(APEX_CPU *cpu, const Reports *reports)
+{
+    FILE *fp;
+
+    if (reports->stats_file && (fp = open_report(reports->stats_file)) != NULL)
+    {
+        if (reports->stats_csv)
+        {
+            APEX_stats_write_csv(cpu, fp);
+        }
+        else
+        {
+            APEX_stats_write_json(cpu, fp);
+        }
+        close_report(fp);
+    }
+    if (reports->profile_file && (fp = open_report(reports->profile_file)) != NULL)
+    {
+        APEX_cpu_print_profile(cpu, fp);
+        close_report(fp);
+    }
+    if (APEX_trace_close(cpu) != 0)
+    {
+        fprintf(stderr, "APEX_Error: The pipeline trace is incomplete\n");
+    }
+    APEX_cpu_stop(cpu);
+}
+
 int main(int argc, char const *argv[])
 {
     APEX_CPU *cpu;
+    const char *args[5];
+    int num_args = 0;
+    long fast_forward = 0;
+    const char *worker_logs = NULL;
+    int mem_changes_only = FALSE;
+    const char *trace_file = NULL;
+    int trace_first = 0, trace_last = INT_MAX;
+    Reports reports = {NULL, FALSE, NULL};
+    APEX_Config config;
+    int num_config_options = 0;
+    int is_checkpoint;
+    int i;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc < 2 || argc > 4)
+    APEX_config_default(&config);
+
+    /* Pull out --options, leaving the positional arguments in args */
+    for (i = 0; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            char name[64];
+            const char *eq = strchr(argv[++i], '=');
+
+            if (!eq || eq - argv[i] >= (int)sizeof(name))
+            {
+                fprintf(stderr, "APEX_Error: Expected --config <name>=<value>\n");
+                exit(1);
+            }
+            memcpy(name, argv[i], eq - argv[i]);
+            name[eq - argv[i]] = '\0';
+            if (APEX_config_set(&config, name, eq + 1) != 0)
+            {
+                fprintf(stderr, "APEX_Error: Invalid configuration %s\n", argv[i]);
+                exit(1);
+            }
+            num_config_options++;
+            continue;
+        }
+        if (strcmp(argv[i], "--fast-forward") == 0 && i + 1 < argc)
+        {
+            fast_forward = atol(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+        {
+            reports.stats_file = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--trace-cycles") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%d:%d", &trace_first, &trace_last) != 2)
+            {
+                fprintf(stderr, "APEX_Error: Expected --trace-cycles <first>:<last>\n");
+                exit(1);
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            reports.profile_file = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--stats-format") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "json") != 0 && strcmp(argv[i], "csv") != 0)
+            {
+                fprintf(stderr, "APEX_Error: Expected --stats-format json or csv\n");
+                exit(1);
+            }
+            reports.stats_csv = strcmp(argv[i], "csv") == 0;
+            continue;
+        }
+        if (strcmp(argv[i], "--mem-changes") == 0)
+        {
+            mem_changes_only = TRUE;
+            continue;
+        }
+        if (strcmp(argv[i], "--worker-logs") == 0 && i + 1 < argc)
+        {
+            worker_logs = argv[++i];
+            continue;
+        }
+        if (num_args == 5)
+        {
+            num_args++;
+            break;
+        }
+        args[num_args++] = argv[i];
+    }
+    argc = num_args;
+    argv = args;
+
+    if (argc < 2 || argc > 5)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> [--fast-forward <insns>] [--config <name>=<value>]\n", args[0]);
+        exit(1);
+    }
+
+    /* Many programs at once, argv[1] lists one program per line */
+    if (argc > 2 && strcmp(argv[2], "parallel") == 0)
+    {
+        int threads = argc > 3 ? atoi(argv[3]) : 0;
+        return APEX_batch_run_programs(argv[1], &config, threads, worker_logs) ? 1 : 0;
+    }
+
+    /* One program over a grid of configurations */
+    if (argc > 3 && strcmp(argv[2], "sweep") == 0)
+    {
+        int threads = argc > 4 ? atoi(argv[4]) : 0;
+        return APEX_batch_sweep(argv[1], argv[3], &config, threads);
+    }
+
+    /* A checkpoint is resumed with the configuration it was taken with */
+    is_checkpoint = APEX_checkpoint_is_file(argv[1]);
+    if (is_checkpoint && num_config_options)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        fprintf(stderr, "APEX_Error: A checkpoint resumes with its own configuration, --config cannot be given\n");
+        exit(1);
+    }
+    if (is_checkpoint && fast_forward > 0)
+    {
+        /* Fast-forwarding would drop the instructions in the pipeline */
+        fprintf(stderr, "APEX_Error: A checkpoint resumes mid-pipeline, --fast-forward cannot be given\n");
         exit(1);
     }
 
-    cpu = APEX_cpu_init(argv[1]);
+    cpu = APEX_cpu_init(argv[1], stderr);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
+    if (!is_checkpoint)
+    {
+        cpu->config = config;
+    }
+    cpu->mem_changes_only = mem_changes_only;
+    if (reports.profile_file && APEX_cpu_enable_profile(cpu) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the profile\n");
+        APEX_cpu_stop(cpu);
+        exit(1);
+    }
+    if (trace_file && APEX_trace_open(cpu, trace_file, trace_first, trace_last) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write trace %s\n", trace_file);
+        APEX_cpu_stop(cpu);
+        exit(1);
+    }
+
+    if (fast_forward > 0)
+    {
+        long executed = APEX_cpu_fast_forward(cpu, fast_forward);
+        fprintf(stderr, "APEX_CPU: Fast-forwarded %ld instructions, PC = %d\n",
+                executed, cpu->pc);
+    }
+
     if (argc == 2)
     {
         APEX_cpu_run(cpu);
-        APEX_cpu_stop(cpu);
+        stop_cpu(cpu, &reports);
         return 0;
     }
     else if (argc > 2)
@@ -43,7 +254,14 @@ int main(int argc, char const *argv[])
         if (strcmp(function_name, "display") == 0)
         {
             APEX_cpu_display(cpu);
-            APEX_cpu_stop(cpu);
+            stop_cpu(cpu, &reports);
+            return 0;
+        }
+
+        if (strcmp(function_name, "batch") == 0)
+        {
+            APEX_cpu_batch(cpu);
+            stop_cpu(cpu, &reports);
             return 0;
         }
 
@@ -51,7 +269,25 @@ int main(int argc, char const *argv[])
         {
             int cycles = atoi(argv[3]);
             APEX_cpu_simulate(cpu, cycles);
-            APEX_cpu_stop(cpu);
+            stop_cpu(cpu, &reports);
+            return 0;
+        }
+
+        if (strcmp(function_name, "checkpoint") == 0 && argc == 5)
+        {
+            int cycles = atoi(argv[3]);
+
+            cpu->debug_messages = FALSE;
+            APEX_cpu_simulate(cpu, cycles);
+            if (APEX_checkpoint_save(cpu, argv[4]) != 0)
+            {
+                fprintf(stderr, "APEX_Error: Unable to write checkpoint %s\n", argv[4]);
+                APEX_cpu_stop(cpu);
+                exit(1);
+            }
+            fprintf(stderr, "APEX_CPU: Checkpoint at cycle %d written to %s\n",
+                    cpu->clock, argv[4]);
+            stop_cpu(cpu, &reports);
             return 0;
         }
 
@@ -59,9 +295,9 @@ int main(int argc, char const *argv[])
         {
             int memory_location = atoi(argv[3]);
             APEX_cpu_show_mem(cpu, memory_location);
-            APEX_cpu_stop(cpu);
+            stop_cpu(cpu, &reports);
             return 0;
         }
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# bad_image.sh
+# apex-asm images and checkpoints with an unknown opcode or an out-of-range
+# register are rejected when loaded instead of being run
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+./apex-asm input.asm "$tmp/good.apx" 2>/dev/null || exit 1
+./apex_sim "$tmp/good.apx" batch >/dev/null 2>&1 || exit 1
+
+# Overwrites a field of the first instruction, which follows the 16 byte
+# header as opcode, rd, rs1, rs2, imm
+patch()
+{
+    cp "$tmp/good.apx" "$tmp/bad.apx"
+    printf "$2" | dd of="$tmp/bad.apx" bs=1 seek=$((16 + 4 * $1)) conv=notrunc 2>/dev/null
+}
+
+# Same for the last instruction of a checkpoint, code memory ends the file
+patch_checkpoint()
+{
+    cp "$tmp/good.ck" "$tmp/bad.apx"
+    size=$(wc -c <"$tmp/good.ck")
+    printf "$2" | dd of="$tmp/bad.apx" bs=1 seek=$((size - 20 + 4 * $1)) conv=notrunc 2>/dev/null
+}
+
+check_rejected()
+{
+    ./apex_sim "$tmp/bad.apx" batch >"$tmp/out" 2>&1
+    status=$?
+    if [ $status -ne 1 ] || ! grep -q "error: $1" "$tmp/out"; then
+        echo "bad_image: $2 not rejected, exit status $status"
+        cat "$tmp/out"
+        exit 1
+    fi
+}
+
+patch 0 '\240\206\001\000' # opcode 100000
+check_rejected "invalid opcode" "opcode 100000"
+
+patch 0 '\031\000\000\000' # opcode 25, unassigned
+check_rejected "invalid opcode" "opcode 25"
+
+patch 1 '\100\102\017\000' # MOVC rd 1000000
+check_rejected "register out of range" "rd 1000000"
+
+patch 3 '\040\000\000\000' # rs2 32
+check_rejected "register out of range" "rs2 32"
+
+./apex_sim input.asm checkpoint 3 "$tmp/good.ck" >/dev/null 2>&1 || exit 1
+patch_checkpoint 0 '\240\206\001\000' # HALT turned into opcode 100000
+check_rejected "invalid opcode" "checkpoint opcode 100000"
+
+patch_checkpoint 2 '\377\377\377\377' # rs1 -1
+check_rejected "register out of range" "checkpoint rs1 -1"
+exit 0
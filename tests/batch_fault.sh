@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# batch_fault.sh
+# Programs that stop on a memory fault are reported as failed by the
+# parallel runner and the configuration sweep, not as completed runs, and
+# the parallel runner writes the fault only to the program's worker log.
+# A sweep point that combines its values into an invalid cache is marked
+# invalid instead of running without the cache.
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cat >"$tmp/fault.asm" <<'ASM'
+MOVC R1,#-5
+LOAD R2,R1,#0
+HALT
+ASM
+printf "input.asm\n%s\n" "$tmp/fault.asm" >"$tmp/programs"
+
+./apex_sim "$tmp/programs" parallel 2 --worker-logs "$tmp/log" >"$tmp/out" 2>"$tmp/err"
+status=$?
+if [ $status -ne 1 ] || ! grep -q "fault.asm *FAULT at pc(4004), address -5" "$tmp/out" ||
+    ! grep -q "failed = 1 (1 faulted)" "$tmp/out"; then
+    echo "batch_fault: parallel run did not report the fault, exit status $status"
+    cat "$tmp/out"
+    exit 1
+fi
+if grep -q "APEX_Error" "$tmp/err" || ! grep -q "Memory fault at pc(4004)" "$tmp/log".* ||
+    [ "$(cat "$tmp/log".* | grep -c "Simulation Complete")" -ne 1 ]; then
+    echo "batch_fault: the fault was not reported in its worker log alone"
+    cat "$tmp/err" "$tmp/log".*
+    exit 1
+fi
+
+./apex_sim "$tmp/fault.asm" sweep "memory_latency=1,2" >"$tmp/out" 2>&1
+status=$?
+if [ $status -ne 1 ] || [ "$(grep -c ',fault$' "$tmp/out")" -ne 2 ]; then
+    echo "batch_fault: sweep did not report the fault, exit status $status"
+    cat "$tmp/out"
+    exit 1
+fi
+
+./apex_sim input.asm sweep "dcache_size=8,16;dcache_assoc=4" >"$tmp/out" 2>&1
+status=$?
+if [ $status -ne 1 ] || ! grep -q "^8,4,0,0,0.0000,invalid$" "$tmp/out" ||
+    ! grep -q "^16,4,.*,halted$" "$tmp/out"; then
+    echo "batch_fault: sweep ran an invalid cache geometry, exit status $status"
+    cat "$tmp/out"
+    exit 1
+fi
+exit 0
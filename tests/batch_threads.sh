@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# batch_threads.sh
+# The parallel runner and the sweep still run every job when worker
+# threads cannot be started, on the threads that did start and on the
+# calling thread
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Fails every pthread_create from the FAIL_FROM-th call on
+cat >"$tmp/shim.c" <<'SHIM'
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void *),
+                   void *arg)
+{
+    static int calls;
+    int (*real)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+
+    if (++calls >= atoi(getenv("FAIL_FROM")))
+    {
+        return EAGAIN;
+    }
+    *(void **)&real = dlsym(RTLD_NEXT, "pthread_create");
+    return real(thread, attr, start, arg);
+}
+SHIM
+${CC:-cc} -shared -fPIC -o "$tmp/shim.so" "$tmp/shim.c" -ldl || exit 1
+printf "input.asm\ninput.asm\ninput.asm\ninput.asm\n" >"$tmp/programs"
+
+for fail_from in 1 3; do
+    FAIL_FROM=$fail_from LD_PRELOAD="$tmp/shim.so" ./apex_sim "$tmp/programs" parallel 4 \
+        >"$tmp/out" 2>&1
+    status=$?
+    if [ $status -ne 0 ] || [ "$(grep -c "^input.asm *26 *18 " "$tmp/out")" -ne 4 ] ||
+        ! grep -q "Programs = 4, failed = 0 (0 faulted), threads = $fail_from" "$tmp/out"; then
+        echo "batch_threads: parallel run with thread $fail_from failing lost jobs, exit status $status"
+        cat "$tmp/out"
+        exit 1
+    fi
+    FAIL_FROM=$fail_from LD_PRELOAD="$tmp/shim.so" ./apex_sim input.asm sweep \
+        "memory_latency=1,2,3,4" 4 >"$tmp/out" 2>&1
+    status=$?
+    if [ $status -ne 0 ] || [ "$(grep -c ',halted$' "$tmp/out")" -ne 4 ]; then
+        echo "batch_threads: sweep with thread $fail_from failing lost points, exit status $status"
+        cat "$tmp/out"
+        exit 1
+    fi
+done
+exit 0
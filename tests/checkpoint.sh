@@ -0,0 +1,108 @@
+#!/bin/sh
+#
+# checkpoint.sh
+# A program resumed from a checkpoint, taken mid-run or after it halted,
+# ends in the same state and configuration as an uninterrupted run, and
+# with a branch predictor or caches in the same number of cycles and with
+# the same statistics. A checkpoint cannot be fast-forwarded.
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Completion line and final architectural state of a batch run
+final_state()
+{
+    sed -n -e '/Simulation Complete/p' -e '/^Registers:/,/^Host:/p' "$1"
+}
+
+./apex_sim input.asm batch >"$tmp/direct" 2>&1 || exit 1
+final_state "$tmp/direct" >"$tmp/expected"
+
+for cycles in 10 25 100; do
+    ./apex_sim input.asm checkpoint $cycles "$tmp/ck" >/dev/null 2>&1 || exit 1
+    if ! timeout 10 ./apex_sim "$tmp/ck" batch >"$tmp/resumed" 2>&1; then
+        echo "checkpoint: resuming after $cycles cycles did not finish"
+        exit 1
+    fi
+    final_state "$tmp/resumed" >"$tmp/actual"
+    if ! cmp -s "$tmp/expected" "$tmp/actual"; then
+        echo "checkpoint: resuming after $cycles cycles ends in a different state"
+        diff "$tmp/expected" "$tmp/actual"
+        exit 1
+    fi
+done
+
+# The configuration is restored too, this program needs the larger memory
+cat >"$tmp/far.asm" <<'ASM'
+MOVC R1,#50000
+MOVC R2,#7
+STORE R2,R1,#0
+LOAD R3,R1,#0
+ADDL R3,R3,#1
+STORE R3,R1,#0
+HALT
+ASM
+./apex_sim "$tmp/far.asm" checkpoint 4 "$tmp/ck" --config memory_size=100000 >/dev/null 2>&1 || exit 1
+timeout 10 ./apex_sim "$tmp/ck" batch >"$tmp/resumed" 2>&1
+if ! grep -q "MEM\[50000\] = 8" "$tmp/resumed"; then
+    echo "checkpoint: resumed without the memory_size it was taken with"
+    cat "$tmp/resumed"
+    exit 1
+fi
+
+# Fast-forwarding would drop the instructions in the pipeline
+./apex_sim input.asm checkpoint 10 "$tmp/ck" >/dev/null 2>&1 || exit 1
+if ./apex_sim "$tmp/ck" batch --fast-forward 5 >"$tmp/out" 2>&1 ||
+    ! grep -q "APEX_Error: .*--fast-forward cannot be given" "$tmp/out"; then
+    echo "checkpoint: --fast-forward was accepted with a checkpoint"
+    cat "$tmp/out"
+    exit 1
+fi
+
+# The trained predictor is restored, a resumed run predicts the same way
+cat >"$tmp/loop.asm" <<'ASM'
+MOVC R1,#6
+MOVC R2,#0
+ADDL R2,R2,#3
+SUBL R1,R1,#1
+BNZ #-8
+HALT
+ASM
+for predictor in bimodal gshare; do
+    for program in input.asm "$tmp/loop.asm"; do
+        ./apex_sim "$program" batch --config predictor=$predictor 2>&1 |
+            grep "Simulation Complete" >"$tmp/expected"
+        for cycles in 8 12 16; do
+            ./apex_sim "$program" checkpoint $cycles "$tmp/ck" --config predictor=$predictor \
+                >/dev/null 2>&1 || exit 1
+            timeout 10 ./apex_sim "$tmp/ck" batch 2>&1 | grep "Simulation Complete" >"$tmp/actual"
+            if ! cmp -s "$tmp/expected" "$tmp/actual"; then
+                echo "checkpoint: $predictor run of $program resumed after $cycles cycles differs"
+                diff "$tmp/expected" "$tmp/actual"
+                exit 1
+            fi
+        done
+    done
+done
+
+# Cache contents and the counters are restored, a resumed run reports the
+# statistics of the whole run
+for caches in "icache_size=16" "dcache_size=16 --config dcache_miss_latency=20"; do
+    ./apex_sim input.asm batch --config $caches 2>&1 | grep -v "Wall clock\|cycles/s" |
+        sed -n '/Simulation Complete/,$p' >"$tmp/expected"
+    for cycles in 10 15 30; do
+        ./apex_sim input.asm checkpoint $cycles "$tmp/ck" --config $caches >/dev/null 2>&1 || exit 1
+        timeout 10 ./apex_sim "$tmp/ck" batch 2>&1 | grep -v "Wall clock\|cycles/s" |
+            sed -n '/Simulation Complete/,$p' >"$tmp/actual"
+        if ! cmp -s "$tmp/expected" "$tmp/actual"; then
+            echo "checkpoint: run with $caches resumed after $cycles cycles differs"
+            diff "$tmp/expected" "$tmp/actual"
+            exit 1
+        fi
+    done
+done
+exit 0
@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# display.sh
+# The per-cycle display keeps the headings of the original simulator,
+# which scripts parse: "Clock Cycle #:" when single stepping and
+# "Clock Cycle:" in the other modes. Memory dumps list the written words in
+# address order, whatever order they were written in, and checkpoints keep
+# them.
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+yes "" | head -40 | ./apex_sim input.asm >"$tmp/run" 2>&1
+./apex_sim input.asm display >"$tmp/display" 2>&1
+if [ "$(grep -c "^Clock Cycle #: " "$tmp/run")" -ne 26 ] ||
+    [ "$(grep -c "^Clock Cycle: " "$tmp/display")" -ne 26 ] ||
+    ! grep -q "Simulation Complete, cycles = 26 instructions = 18" "$tmp/run" ||
+    ! grep -q "Simulation Complete, cycles = 26 instructions = 18" "$tmp/display"; then
+    echo "display: unexpected per-cycle headings"
+    exit 1
+fi
+
+cat >"$tmp/down.asm" <<'ASM'
+MOVC R1,#3000
+MOVC R2,#5
+MOVC R3,#0
+STORE R2,R1,#0
+STORE R2,R1,#-1000
+STORE R3,R1,#-1500
+STORE R2,R1,#-2999
+STORE R2,R1,#1000
+HALT
+ASM
+printf "MEM[1] = 5\nMEM[2000] = 5\nMEM[3000] = 5\nMEM[4000] = 5\n" >"$tmp/expected"
+./apex_sim "$tmp/down.asm" batch --config memory_size=8192 2>&1 | grep "^MEM" >"$tmp/actual"
+./apex_sim "$tmp/down.asm" checkpoint 10 "$tmp/ck" --config memory_size=8192 >/dev/null 2>&1 || exit 1
+./apex_sim "$tmp/ck" batch 2>&1 | grep "^MEM" >"$tmp/resumed"
+if ! cmp -s "$tmp/expected" "$tmp/actual" || ! cmp -s "$tmp/expected" "$tmp/resumed"; then
+    echo "display: memory dump is not the written words in address order"
+    cat "$tmp/actual" "$tmp/resumed"
+    exit 1
+fi
+exit 0
@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# fetch_fault.sh
+# A program that runs past its last instruction or jumps outside code
+# memory stops with a fetch fault on every core, resumed from a checkpoint
+# or fast-forwarded, while fetching past the end on a path a branch then
+# leaves is not a fault
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cat >"$tmp/nohalt.asm" <<'ASM'
+MOVC R1,#1
+ADD R2,R1,R1
+ASM
+cat >"$tmp/jump.asm" <<'ASM'
+MOVC R1,#8000
+JUMP R1,#0
+HALT
+ASM
+cat >"$tmp/below.asm" <<'ASM'
+MOVC R1,#3998
+JUMP R1,#0
+HALT
+ASM
+cat >"$tmp/back.asm" <<'ASM'
+MOVC R1,#4012
+JUMP R1,#0
+HALT
+JUMP R1,#-4
+ASM
+
+# Runs a program in batch mode and checks for the fetch fault at pc
+expect_fault()
+{
+    name=$1
+    pc=$2
+    shift 2
+    timeout 10 ./apex_sim "$@" batch >"$tmp/out" 2>&1
+    status=$?
+    if [ $status -ne 0 ] || ! grep -q "APEX_Error: Fetch fault at pc($pc)" "$tmp/out" ||
+        grep -q "Simulation Complete" "$tmp/out"; then
+        echo "fetch_fault: $name did not stop with a fetch fault at pc($pc), exit status $status"
+        cat "$tmp/out"
+        exit 1
+    fi
+}
+
+for core in "width=1" "width=2" "core=ooo"; do
+    expect_fault "nohalt $core" 4008 "$tmp/nohalt.asm" --config $core
+    expect_fault "jump $core" 8000 "$tmp/jump.asm" --config $core
+    expect_fault "below $core" 3998 "$tmp/below.asm" --config $core
+    timeout 10 ./apex_sim "$tmp/back.asm" batch --config $core >"$tmp/out" 2>&1
+    if ! grep -q "Simulation Complete, cycles = .* instructions = 4" "$tmp/out" ||
+        grep -q "APEX_Error" "$tmp/out"; then
+        echo "fetch_fault: fetching past the end on the wrong path faulted with $core"
+        cat "$tmp/out"
+        exit 1
+    fi
+done
+expect_fault "fast-forwarded nohalt" 4008 "$tmp/nohalt.asm" --fast-forward 10
+
+for cycles in 1 3 5; do
+    ./apex_sim "$tmp/jump.asm" checkpoint $cycles "$tmp/ck" >/dev/null 2>&1 || exit 1
+    expect_fault "jump resumed after $cycles cycles" 8000 "$tmp/ck"
+done
+
+printf "%s\n%s\n" "$tmp/nohalt.asm" "$tmp/jump.asm" >"$tmp/programs"
+./apex_sim "$tmp/programs" parallel 2 >"$tmp/out" 2>&1
+if ! grep -q "nohalt.asm *FAULT at pc(4008) outside code memory" "$tmp/out" ||
+    ! grep -q "jump.asm *FAULT at pc(8000) outside code memory" "$tmp/out" ||
+    ! grep -q "failed = 2 (2 faulted)" "$tmp/out"; then
+    echo "fetch_fault: parallel run did not report the fetch faults"
+    cat "$tmp/out"
+    exit 1
+fi
+exit 0
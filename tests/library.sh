@@ -0,0 +1,61 @@
+#!/bin/sh
+#
+# library.sh
+# A C++ host links against libapex.a through apex.h and runs a program to
+# HALT with the step API, and one that leaves code memory to its fetch fault
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cat >"$tmp/host.cc" <<'HOST'
+#include <stdio.h>
+
+#include "apex.h"
+
+int main(int argc, char *argv[])
+{
+    char error[256];
+    APEX_CPU *cpu = apex_create(argv[1], "memory_latency=1", error, sizeof(error));
+    int value = 0;
+    int pc, address;
+
+    if (!cpu)
+    {
+        printf("error: %s\n", error);
+        return 1;
+    }
+    while (apex_step(cpu, 5) == APEX_STATUS_RUNNING)
+    {
+    }
+    apex_memory(cpu, 1008, &value);
+    printf("status %d cycles %ld instructions %ld MEM[1008] %d\n", apex_status(cpu),
+           apex_cycles(cpu), apex_instructions(cpu), value);
+    if (apex_fault(cpu, &pc, &address) == 0)
+    {
+        printf("fault pc %d address %d\n", pc, address);
+    }
+    apex_destroy(cpu);
+    return 0;
+}
+HOST
+
+${CXX:-c++} -I. -o "$tmp/host" "$tmp/host.cc" libapex.a -lpthread || exit 1
+"$tmp/host" input.asm >"$tmp/out" 2>&1
+if ! grep -q "^status 1 cycles 26 instructions 18 MEM\[1008\] 250$" "$tmp/out"; then
+    echo "library: unexpected result"
+    cat "$tmp/out"
+    exit 1
+fi
+
+printf "MOVC R1,#8000\nJUMP R1,#0\nHALT\n" >"$tmp/jump.asm"
+"$tmp/host" "$tmp/jump.asm" >"$tmp/out" 2>&1
+if ! grep -q "^status 3 " "$tmp/out" || ! grep -q "^fault pc 8000 address 8000$" "$tmp/out"; then
+    echo "library: the fetch fault was not reported"
+    cat "$tmp/out"
+    exit 1
+fi
+exit 0
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# observers.sh
+# Observers registered through libapex see one retire event per retired
+# instruction, in program order, and stall and flush events that match the
+# run, with and without cycle skipping
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cat >"$tmp/host.c" <<'HOST'
+#include <stdio.h>
+
+#include "apex.h"
+
+typedef struct Counts
+{
+    long events[6];
+    long last_seq;
+    int out_of_order;
+} Counts;
+
+static void
+count_event(APEX_CPU *cpu, const apex_event *event, void *arg)
+{
+    Counts *counts = arg;
+    int i;
+
+    for (i = 0; i < 6; ++i)
+    {
+        if (event->type == 1 << i)
+        {
+            counts->events[i]++;
+        }
+    }
+    if (event->type == APEX_EVENT_RETIRE)
+    {
+        counts->out_of_order |= event->seq <= counts->last_seq;
+        counts->last_seq = event->seq;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Counts counts = {{0}, 0, 0};
+    char error[256];
+    APEX_CPU *cpu = apex_create(argv[1], argv[2], error, sizeof(error));
+
+    if (!cpu)
+    {
+        printf("error: %s\n", error);
+        return 1;
+    }
+    apex_observe(cpu, APEX_EVENT_ALL, count_event, &counts);
+    apex_run_until(cpu, NULL, NULL);
+    printf("instructions %ld retired %ld in_order %d fetched %ld stalls %ld flushes %ld\n",
+           apex_instructions(cpu), counts.events[5], !counts.out_of_order, counts.events[0],
+           counts.events[2], counts.events[3]);
+    apex_destroy(cpu);
+    return 0;
+}
+HOST
+
+${CC:-cc} -I. -o "$tmp/host" "$tmp/host.c" libapex.a -lpthread || exit 1
+for options in "" "cycle_skip=0" "memory_latency=3" "width=2" "core=ooo"; do
+    "$tmp/host" input.asm "$options" >"$tmp/out" 2>&1
+    if ! grep -q "^instructions 18 retired 18 in_order 1 " "$tmp/out"; then
+        echo "observers: unexpected events with '$options'"
+        cat "$tmp/out"
+        exit 1
+    fi
+done
+
+# Cycle skipping must not change what is observed
+"$tmp/host" input.asm "memory_latency=5" >"$tmp/skip" 2>&1
+"$tmp/host" input.asm "memory_latency=5 cycle_skip=0" >"$tmp/noskip" 2>&1
+if ! cmp -s "$tmp/skip" "$tmp/noskip"; then
+    echo "observers: cycle skipping changed the events"
+    diff "$tmp/skip" "$tmp/noskip"
+    exit 1
+fi
+exit 0
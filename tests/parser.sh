@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# parser.sh
+# The assembler reports every malformed line as file:line:column and loads
+# nothing, and accepts the sample program
+#
+# Author:
+# Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+# State University of New York at Binghamton
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cat >"$tmp/bad.asm" <<'ASM'
+MOVC R1,#1
+FOO R1
+ADD R1 R2,R3
+ADDL R1,R2,#x
+MOVC R40,#1
+HALT extra
+ASM
+cat >"$tmp/expected" <<EOF_EXPECTED
+$tmp/bad.asm:2:1: error: unknown instruction 'FOO'
+$tmp/bad.asm:3:8: error: expected ',' before operand 2
+$tmp/bad.asm:4:12: error: invalid number '#x'
+$tmp/bad.asm:5:6: error: no such register 'R40'
+$tmp/bad.asm:6:6: error: unexpected 'extra' after instruction
+EOF_EXPECTED
+
+./apex-asm "$tmp/bad.asm" "$tmp/bad.apx" 2>&1 | grep "error:" >"$tmp/actual"
+if [ -e "$tmp/bad.apx" ] || ! cmp -s "$tmp/expected" "$tmp/actual"; then
+    echo "parser: unexpected diagnostics"
+    diff "$tmp/expected" "$tmp/actual"
+    exit 1
+fi
+
+./apex-asm input.asm "$tmp/input.apx" 2>/dev/null || exit 1
+exit 0